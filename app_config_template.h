@@ -29,9 +29,33 @@
 
 #define INITIAL_CHANNEL_POWER       0   // Off.
 #define MAX_CHANNEL_POWER_LEVEL     0xFFF   // 12-bit DAC
+// Fastest rise in channel power level, in power levels per second, stepped every update timer tick. Drops are
+// immediate. 0 applies power levels straight away.
+#define POWER_SLEW_RATE             0x2000  // Off to full power in 0.5 s
+// Rise in power level per second as a channel soft-starts from off, on pulse_resume & pattern start. 0 disables.
+#define POWER_SOFT_START_RATE       0x1000
+// Scales channel power down to hold the charge delivered within each window's limits, tallied every pulse period.
+#define CHARGE_LIMITER              0
+// X(window_ms, mean_limit, rms_limit): limits are in power levels, averaged over the window with each pulse period
+// weighted by its gates' on time. Mean bounds charge, RMS bounds heating. A limit of 0 doesn't apply.
+// These limits are placeholders, not calibrated against any electrode or load. Calibrate them before enabling.
+#define CHARGE_WINDOW_MAP_X \
+    X(1000, 0x200, 0), \
+    X(60000, 0x140, 0x400)
+// Windows slide a bucket at a time, so each covers between (buckets - 1) / buckets and all of its length.
+#define CHARGE_WINDOW_BUCKETS       8
 #define MAX_PATTERN_ADJUST          0xFFF   // 4k of adjustment is probably enough
 #define MAX_PULSE_WIDTH             200     // in micro-seconds
 
+// Update each pattern channel only when its output next changes, instead of every UPDATE_TIMER_FREQ_Hz tick.
+#define PATTERN_DEADLINE_SCHEDULING 1
+// Evaluate patterns in the pulse timer interrupt at every pulse period, instead of from app_timer.
+#define PATTERN_INTERPOLATE_PER_PULSE 0
+// Patterns each channel can play on top of its main pattern. Each layer adds a playback plan (~3 kB) per channel.
+#define PATTERN_LAYER_COUNT 1
+// Elements each channel buffers for STREAM_ELEMENTS, a power of 2. Each takes 16 bytes. 0 disables streaming.
+#define STREAM_BUFFER_ELEMENTS 64
+
 // #define CHANNEL_0_POWER             1
 // #define CHANNEL_1_POWER             1
 // #define CHANNEL_2_POWER             1
@@ -43,6 +67,17 @@
 
 // No TENS effect > ~500 Hz. Should probably also limit power delivery.
 #define MIN_PULSE_VALUE             2000 // Minimum initial pulse edge, in micro-seconds
+// Shortest gap between burst sub-pulses, in micro-seconds, for the pulse interrupt to move edges on to the next one.
+// 0 disables bursts.
+#define PULSE_BURST_MIN_GAP_us      250
+// Play pulses from PWM peripheral sequences instead of timers, PPI & GPIOTE, so steady pulses need no CPU.
+// Incompatible with PATTERN_INTERPOLATE_PER_PULSE.
+#define PULSE_OUTPUT_PWM            0
+// PWM periods in each of a channel's 2 sequence buffers. Each takes 8 bytes.
+#define PULSE_PWM_SEQUENCE_WAVES    64
+// Delay pulse periods so gate-on windows of channels with equal periods overlap least, flattening peak current.
+// Timer pulse output only. 0 staggers channels by a fixed offset instead.
+#define PULSE_PHASE_INTERLEAVE      1
 
 #define SCHEDULER_QUEUE_SIZE 12
 
@@ -79,6 +114,16 @@
 #define CHANNEL1_TIMER_INSTANCE 2
 #define CHANNEL2_TIMER_INSTANCE 3
 #define CHANNEL3_TIMER_INSTANCE 4
+// Channel pulse PWM, instead of timers when PULSE_OUTPUT_PWM
+#define NRFX_PWM_ENABLED PULSE_OUTPUT_PWM
+#define NRFX_PWM0_ENABLED PULSE_OUTPUT_PWM
+#define NRFX_PWM1_ENABLED PULSE_OUTPUT_PWM
+#define NRFX_PWM2_ENABLED PULSE_OUTPUT_PWM
+#define NRFX_PWM3_ENABLED PULSE_OUTPUT_PWM
+#define CHANNEL0_PWM_INSTANCE 0
+#define CHANNEL1_PWM_INSTANCE 1
+#define CHANNEL2_PWM_INSTANCE 2
+#define CHANNEL3_PWM_INSTANCE 3
 // GPIOTE & PPI to control MOSFETs from pulse timers
 #define NRFX_GPIOTE_ENABLED 1
 #define NRFX_PPI_ENABLED 1
@@ -8,6 +8,11 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+// Newlib's sys/cdefs.h defines __packed, host C libraries may not.
+#ifndef __packed
+#define __packed __attribute__((__packed__))
+#endif
+
 /// Max byte length is 4076 due to flash page size & storage library metadata.
 #define MAX_PATTERN_BYTE_LENGTH 4076
 #define MAX_PATTERN_ELEMENT_COUNT 337
@@ -16,10 +21,38 @@
 #define PULSE_EDGES 4
 typedef uint16_t zappy_pulse_t[PULSE_EDGES];
 
+/**@brief   Length of the timer ticks pulse values count, per channel.
+ *
+ * Pulse values stay 16 bits, so finer ticks trade maximum period for edge precision. Periods can't be shorter than
+ * MIN_PULSE_VALUE (2000 us), which stays in microseconds, so finer ticks also narrow the usable window.
+ */
+typedef enum __packed {
+    PULSE_RESOLUTION_1_US = 0x0,       /**< 1 MHz ticks, periods of 2.0 - 65.5 ms. Default. */
+    PULSE_RESOLUTION_62_5_NS = 0x1,    /**< 16 MHz ticks, periods of 2.0 - 4.1 ms, edges from 32000 ticks. */
+    PULSE_RESOLUTION_16_US = 0x2,      /**< 62.5 kHz ticks, periods of 2.0 ms - 1.05 s. */
+    // Not a resolution
+    PULSE_RESOLUTION_COUNT
+} pulse_resolution_t;
+
 /// Don't define more than 16 functions
 typedef enum __packed {
     EASING_LINEAR = 0x0,           /**< Linear interpolation between each of the 4 pulse values independently */
-    // TODO: Implement some subset of https://easings.net/en
+    /* Subset of https://easings.net/en, applied to each of the 4 pulse values & power modulator independently.
+     * Each family costs three 258 byte tables of flash & 3 of the 14 codes, so quad & expo are left out: quad is
+     * close to sine & cubic, expo to cubic. Elastic & bounce have no near substitute. */
+    EASING_SINE_IN = 0x1,
+    EASING_SINE_OUT = 0x2,
+    EASING_SINE_IN_OUT = 0x3,
+    EASING_CUBIC_IN = 0x4,
+    EASING_CUBIC_OUT = 0x5,
+    EASING_CUBIC_IN_OUT = 0x6,
+    EASING_ELASTIC_IN = 0x7,       /**< Overshoots, resulting values are clamped. */
+    EASING_ELASTIC_OUT = 0x8,      /**< Overshoots, resulting values are clamped. */
+    EASING_ELASTIC_IN_OUT = 0x9,   /**< Overshoots, resulting values are clamped. */
+    EASING_BOUNCE_IN = 0xA,
+    EASING_BOUNCE_OUT = 0xB,
+    EASING_BOUNCE_IN_OUT = 0xC,
+    // 0xD - 0xE reserved, eased as linear
     // Max value
     EASING_NONE = 0xF              /**< No interpolation between pattern elements. */
 } easing_function_t;
@@ -54,6 +87,98 @@ typedef struct __packed {
                                                 *                                              0xFFF              */
 } zappy_pattern_element_t;         // 12 bytes total
 
+/**@brief   Control element opcodes, for patterns of major version 2 and above.
+ *
+ * Elements with a duration of zero are control elements, which take no time and redirect playback. Element
+ * indexes in arguments are 0-indexed, and indexes past the last element restart the pattern.
+ */
+typedef enum __packed {
+    PATTERN_OP_JUMP = 0x0,          /**< Continue at element args[0]. */
+    PATTERN_OP_LOOP = 0x1,          /**< Jump to element args[0], args[1] times before continuing. 0 jumps forever. */
+    PATTERN_OP_REPEAT = 0x2,        /**< Play the next element args[0] additional times. */
+    PATTERN_OP_LOOP_START = 0x3,    /**< Preceding elements are an intro, reaching the end restarts after this. */
+    PATTERN_OP_RANDOM = 0x4,        /**< Jump to element args[0] with probability args[1] / 0x10000. */
+    PATTERN_OP_SEED = 0x5,          /**< Seed random branches with (args[1] << 16) | args[0], for repeatable play. */
+    PATTERN_OP_GENERATOR = 0x6,     /**< Only valid as the first element, see zappy_pattern_generator_t. */
+    PATTERN_OP_TRACKS = 0x7,        /**< Only valid as the first element, see zappy_pattern_tracks_t. */
+    PATTERN_OP_RESOLUTION = 0x8,    /**< Only valid as the last element, pulse values count param ticks of
+                                     *   pulse_resolution_t. Patterns without it count microseconds. */
+    PATTERN_OP_BURST = 0x9,         /**< Following elements play args[0] sub-pulses per period, args[1] pulse ticks
+                                     *   apart. The last sub-pulse ends the period. 0 or 1 plays single pulses. */
+    // Not an opcode
+    PATTERN_OP_COUNT
+} pattern_opcode_t;
+
+/**@brief   Control element definition, overlaid on zappy_pattern_element_t. */
+typedef struct __packed {
+    uint16_t            args[PULSE_EDGES];  /**< Opcode arguments, in place of pulse. */
+    uint16_t            duration;           /**< Always 0 for control elements. */
+    uint16_t            param : 4;          /**< Opcode parameter, in place of easing. */
+    uint16_t            opcode : 12;        /**< pattern_opcode_t, in place of power modulator. */
+} zappy_pattern_control_t;         // 12 bytes total
+
+/// Don't define more than 16 waveforms
+typedef enum __packed {
+    WAVEFORM_SINE = 0x0,
+    WAVEFORM_TRIANGLE = 0x1,
+    WAVEFORM_SQUARE = 0x2,         /**< Low for the first half of each period. */
+    WAVEFORM_SAW = 0x3,
+    WAVEFORM_NOISE = 0x4,          /**< Smoothly interpolated random level, changing once per period. */
+    // Not a waveform
+    WAVEFORM_COUNT
+} pattern_waveform_t;
+
+/**@brief   Generator pattern definition, overlaid on the elements of a version 2 pattern.
+ *
+ * Instead of playing elements in sequence, the pattern output follows a waveform between two pulse states.
+ * Every waveform starts at the low state. Sweeping the period from start to end, then restarting the sweep,
+ * produces a chirp.
+ *
+ * ADJUST_PLAYBACK_SPEED scales the waveform rate, using the duration of the low state element as reference.
+ */
+typedef struct __packed {
+    struct __packed {
+        uint16_t        period;             /**< Waveform period at start of sweep, in milliseconds. */
+        uint16_t        sweep_period;       /**< Waveform period at end of sweep, in milliseconds. 0 to not sweep. */
+        uint16_t        sweep_duration;     /**< Duration of sweep, in seconds. */
+        uint16_t        seed;               /**< WAVEFORM_NOISE random seed. */
+        uint16_t        duration;           /**< Always 0, marks element as control element. */
+        uint16_t        waveform : 4;       /**< pattern_waveform_t. */
+        uint16_t        opcode : 12;        /**< PATTERN_OP_GENERATOR. */
+    } control;
+    zappy_pattern_element_t low;            /**< Pulse state at the waveform minimum. Non-zero duration. */
+    zappy_pattern_element_t high;           /**< Pulse state at the waveform maximum. Non-zero duration. */
+} zappy_pattern_generator_t;       // 36 bytes total
+
+/**@brief   Multi-track pattern definition, overlaid on the first element of a version 2 pattern.
+ *
+ * The remaining elements are frames of one element per track, so element 1 + frame * tracks + n is track n of a
+ * frame. Track n plays on channel n. All tracks share the timeline set by the durations of track 0, durations of
+ * other tracks are ignored. Frames play in sequence and repeat, control elements aren't interpreted within frames.
+ */
+typedef struct __packed {
+    uint16_t            tracks;             /**< Number of tracks, from 1 to the device channel count. */
+    uint16_t            reserved[PULSE_EDGES - 1];
+    uint16_t            duration;           /**< Always 0, marks element as control element. */
+    uint16_t            param : 4;          /**< Unused. */
+    uint16_t            opcode : 12;        /**< PATTERN_OP_TRACKS. */
+} zappy_pattern_tracks_t;          // 12 bytes total
+
+/// How a layer pattern's pulse edges combine with the pattern beneath it.
+typedef enum __packed {
+    LAYER_EDGES_KEEP = 0x0,        /**< Edges from beneath are unchanged. */
+    LAYER_EDGES_OVERRIDE = 0x1,    /**< Edges are replaced by the layer's edges. */
+    LAYER_EDGES_MIN = 0x2,         /**< Each edge is the earlier of the two. A disabled (0) edge stays disabled. */
+    LAYER_EDGES_MAX = 0x3,         /**< Each edge is the later of the two. */
+} layer_edge_mix_t;
+
+/// How a layer pattern's power modulator combines with the pattern beneath it.
+typedef enum __packed {
+    LAYER_POWER_KEEP = 0x0,        /**< Power modulator from beneath is unchanged. */
+    LAYER_POWER_OVERRIDE = 0x1,    /**< Power modulator is replaced by the layer's. */
+    LAYER_POWER_MULTIPLY = 0x2,    /**< Output power fractions of both multiply, so the layer acts as an envelope. */
+} layer_power_mix_t;
+
 /**@brief   Version half-word for zappy patterns */
 typedef struct __packed {
     uint16_t patch : 6;
@@ -61,13 +186,16 @@ typedef struct __packed {
     uint16_t major : 4;
 } zappy_pattern_version_t;
 
+/// First major pattern version with control elements.
+#define ZAPPY_PATTERN_VERSION_CONTROL_ELEMENTS 2
+
 /**@brief The highest level pattern understood by this firmware. */
 #define ZAPPY_PATTERN_VERSION   \
 {                               \
-    .major = 1;                 \
-    .minor = 0;                 \
-    .patch = 0;                 \
-};
+    .major = 2,                 \
+    .minor = 0,                 \
+    .patch = 0,                 \
+}
 
 /* 4076
  *  - sizeof(pattern_adjust) = 2
@@ -67,8 +67,9 @@
  *                      the values specified in the payload. The order of values and bitfields are the same.
  *
  *                      If any channels are updated, the response payload will contain the actual values set on the
- *                      device. If no valid channels are selected, the response retcode will be NOOP and there
- *                      will be no response payload.
+ *                      device. Rises ramp up when the device is built with a slew rate, so these are the levels
+ *                      reached so far, which GET_POWERS follows up. If no valid channels are selected, the response
+ *                      retcode will be NOOP and there will be no response payload.
  *      Command:
  *          Header: { SET_POWERS, channel selector bitfield }
  *          Payload: Uint16LE per channel
@@ -108,15 +109,16 @@
  *          Payload: None
  *      Response:
  *          Header: { GET_PULSE, channel bitflag for payload or NOOP if invalid channels selected }
- *          Payload: 4x Uint16LE pulse timer values, in microseconds
+ *          Payload: 4x Uint16LE pulse timer values, in ticks of the channel's pulse resolution
  *
  *
  *  SET_PULSE            Set pulse timer values for selected channels
  *      Command:
  *          Header: { SET_PULSE, channel selector bitfield }
- *          Payload: 4x Uint16LE pulse timer values, in microseconds
+ *          Payload: 4x Uint16LE pulse timer values, in ticks of each channel's pulse resolution
  *      Response:
- *          Header: { SET_PULSE, SUCCESS if any selected channels are valid or else NOOP }
+ *          Header: { SET_PULSE, SUCCESS if any selected channels are valid, PARSE_ERROR if no pulse value is at
+ *                    least MIN_PULSE_VALUE in a selected channel's ticks, or else NOOP }
  *          Payload: None
  *
  *  @note:
@@ -124,9 +126,55 @@
  *      A pulse ends after the last edge of the prior pulse is triggered, which resets timer to zero.
  *      Pulse timer value order is { positive_toggle, positive_toggle, negative_toggle, negative_toggle }.
  *      Pulse timer values of less than MIN_PULSE_VALUE are ignored and will not trigger their respective edge.
+ *      At least one value must be MIN_PULSE_VALUE or more, to end the pulse, else the channel keeps its prior
+ *      pulse. Channels selected before the rejected one are set.
  *      Use with care.
  *
  *
+ *  SET_PULSE_RESOLUTION Set the length of the timer ticks pulse values count, for selected channels. Playing a
+ *                       pattern sets its channels to the pattern's resolution, see PATTERN_OP_RESOLUTION.
+ *      Command:
+ *          Header: { SET_PULSE_RESOLUTION, channel selector bitfield }
+ *          Payload: Uint16LE pulse_resolution_t
+ *      Response:
+ *          Header: { SET_PULSE_RESOLUTION, SUCCESS, PARSE_ERROR for an unknown resolution, or NOOP if no valid
+ *                    channels selected }
+ *          Payload: None
+ *
+ *  @note:
+ *      The channel timer restarts, and the current pulse values are reinterpreted at the new resolution until the
+ *      next SET_PULSE. MIN_PULSE_VALUE stays in microseconds, so 62.5 ns ticks limit periods to 2 - 4.1 ms.
+ *
+ *
+ *  SET_PULSE_BURST      Set the burst of sub-pulses selected channels play each pulse period, from their next
+ *                       SET_PULSE. Playing patterns set bursts from their PATTERN_OP_BURST elements instead.
+ *      Command:
+ *          Header: { SET_PULSE_BURST, channel selector bitfield }
+ *          Payload: zappy_burst_msg_t
+ *      Response:
+ *          Header: { SET_PULSE_BURST, SUCCESS if any selected channels are valid or else NOOP }
+ *          Payload: None
+ *
+ *  @note:
+ *      Each sub-pulse repeats the pulse timer values, spacing ticks earlier than the next, and the last ends the
+ *      period. Spacing is widened to leave PULSE_BURST_MIN_GAP_us between sub-pulses, and sub-pulses that would
+ *      start before MIN_PULSE_VALUE are dropped.
+ *
+ *
+ *  GET_CHARGE_HEADROOM  Retrieves how much of the charge limiter's window limits each channel has left, and the
+ *                       scale the limiter holds its power to.
+ *      Command:
+ *          Header: { GET_CHARGE_HEADROOM, ignored }
+ *          Payload: None
+ *      Response:
+ *          Header: { GET_CHARGE_HEADROOM, SUCCESS }
+ *          Payload: zappy_charge_status_t per channel
+ *
+ *  @note:
+ *      Headroom is the share left of the channel's most used limit, as a fraction of 0x10000 capped at 0xFFFF, so 0
+ *      means the limiter is holding the channel down. Limits are set by CHARGE_WINDOW_MAP_X.
+ *
+ *
  *  GET_PATTERN          Retrieves the pattern stored on the device at a given index, if any. An invalid pattern
  *                       index will result in ERROR_INVALID_INDEX retcode. Patterns are 1-indexed.
  *      Command:
@@ -159,6 +207,63 @@
  *          Payload: None
  *
  *
+ *  PLAY_LAYER           Plays a pattern on a layer of the selected channels, on top of each channel's main pattern.
+ *                       Layer output combines with the output beneath it by the edge and power mix rules. Layers
+ *                       keep playing when the main pattern changes, and only output while a main pattern plays.
+ *                       A pattern index of zero stops the layer. An invalid pattern index will result in
+ *                       ERROR_INVALID_INDEX retcode. An invalid layer or a multi-track pattern will result in
+ *                       ERROR_PARSE_ERROR retcode.
+ *      Command:
+ *          Header: { PLAY_LAYER, channel selector bitfield }
+ *          Payload: zappy_layer_msg_t
+ *      Response:
+ *          Header: { PLAY_LAYER, SUCCESS or ERROR_INVALID_INDEX or ERROR_PARSE_ERROR or NOOP }
+ *          Payload: None
+ *
+ *
+ *  GET_PLAYLIST         Retrieves the playlist of the lowest selected channel.
+ *      Command:
+ *          Header: { GET_PLAYLIST, channel selector bitfield }
+ *          Payload: None
+ *      Response:
+ *          Header: { GET_PLAYLIST, channel bitflag for payload or NOOP if invalid channels selected }
+ *          Payload: zappy_playlist_t
+ *
+ *
+ *  SET_PLAYLIST         Plays a playlist on the selected channels, starting from its first entry. Each entry plays
+ *                       for a number of passes through its pattern or for a duration, then playback moves on to the
+ *                       next entry without involving the host. The next entry's pattern is prepared in advance, and
+ *                       transitions either gaplessly or by crossfading from the previous entry. Without repeat, the
+ *                       last entry keeps playing. Pattern adjust values carry over between entries.
+ *
+ *                       An entry count of zero clears the playlist, leaving the current pattern playing. Any entry
+ *                       with an invalid pattern index results in ERROR_INVALID_INDEX retcode. Too many entries,
+ *                       entries without a loop count or duration, or multi-track patterns result in ERROR_PARSE_ERROR
+ *                       retcode. Playing a pattern with PLAY_PATTERN clears the playlist of its channels.
+ *      Command:
+ *          Header: { SET_PLAYLIST, channel selector bitfield }
+ *          Payload: zappy_playlist_t
+ *      Response:
+ *          Header: { SET_PLAYLIST, SUCCESS or ERROR_INVALID_INDEX or ERROR_PARSE_ERROR or NOOP }
+ *          Payload: None
+ *
+ *
+ *  STREAM_ELEMENTS      Adds host generated elements to the playback buffer of the selected channels. The first
+ *                       elements streamed to a channel stop its pattern, and playback continues until a pattern or
+ *                       playlist is played on the channel. Elements start at their timestamps, delayed by the latency
+ *                       target, and transition to the next element as they would in a pattern. The latency target
+ *                       sets how much timing jitter the buffer absorbs. If the buffer runs out, output holds the
+ *                       last element, and playback restarts the latency target after the next elements arrive.
+ *                       Elements that don't fit in the buffer are dropped, and elements arriving too late to play
+ *                       are skipped. Streaming zero elements retrieves buffer status.
+ *      Command:
+ *          Header: { STREAM_ELEMENTS, channel selector bitfield }
+ *          Payload: zappy_stream_msg_t
+ *      Response:
+ *          Header: { STREAM_ELEMENTS, channel bitflag for payload or NOOP if invalid channels selected }
+ *          Payload: zappy_stream_status_t of the lowest selected channel
+ *
+ *
  *  GET_PATTERN_PROGRESS    Retrieves the progress of a pattern playback on a channel as a percentage
  *                          of 0x10000. Because 0x10000 is functionally the same as 0, only values
  *                          0x0000 - 0xFFFF are returned. Non-playing channels will return 0.
@@ -246,10 +351,17 @@
 /* Low-level pulse control */ \
     X(OP_GET_PULSE, 0x11) \
     X(OP_SET_PULSE, 0x12) \
+    X(OP_SET_PULSE_RESOLUTION, 0x13) \
+    X(OP_SET_PULSE_BURST, 0x14) \
+    X(OP_GET_CHARGE_HEADROOM, 0x15) \
 /* Pattern info & playback */ \
     X(OP_GET_PATTERN, 0x20) \
     X(OP_PLAY_PATTERN, 0x21) \
     X(OP_GET_PATTERN_TITLE, 0x22)              \
+    X(OP_PLAY_LAYER, 0x23)                     \
+    X(OP_GET_PLAYLIST, 0x24)                   \
+    X(OP_SET_PLAYLIST, 0x25)                   \
+    X(OP_STREAM_ELEMENTS, 0x26)                \
     X(OP_GET_PATTERN_PROGRESS, 0x28)           \
     X(OP_SET_PATTERN_PROGRESS, 0x29)           \
 /* Pattern storage controls */                  \
@@ -293,6 +405,61 @@ typedef struct __packed {
     uint16_t payload[];
 } zappy_msg_t;
 
+typedef struct __packed {
+    pattern_index_t index;          /**< Pattern played on the layer. 0 stops the layer. */
+    uint8_t layer;                  /**< Layer number, from 1 to PATTERN_LAYER_COUNT. */
+    layer_edge_mix_t edges : 4;
+    layer_power_mix_t power : 4;
+} zappy_layer_msg_t;
+
+typedef struct __packed {
+    uint16_t count;                 /**< Sub-pulses per pulse period. 0 or 1 plays single pulses. */
+    uint16_t spacing;               /**< Time between the starts of consecutive sub-pulses, in pulse ticks. */
+} zappy_burst_msg_t;
+
+typedef struct __packed {
+    uint16_t headroom;              /**< Share left of the most used charge limit, of 0x10000 capped at 0xFFFF. */
+    uint16_t scale;                 /**< Power let through by the charge limiter, of 0xFFF. */
+} zappy_charge_status_t;
+
+#define PLAYLIST_MAX_ENTRIES 16
+/// Timestamps wrap after ~71 minutes, so longer entries must use a loop count.
+#define PLAYLIST_MAX_DURATION_s 2100
+
+typedef struct __packed {
+    pattern_index_t index;          /**< Pattern played. Patterns are 1-indexed. */
+    uint16_t loops;                 /**< Passes through the pattern. 0 to play for duration instead. */
+    uint16_t duration;              /**< Play time in seconds, used when loops is 0. Max of PLAYLIST_MAX_DURATION_s. */
+    uint16_t crossfade;             /**< Crossfade from the previous entry, in milliseconds. 0 for gapless. */
+} zappy_playlist_entry_t;
+
+typedef struct __packed {
+    uint16_t entry_count;           /**< Max of PLAYLIST_MAX_ENTRIES. */
+    uint8_t repeat;                 /**< Non-zero to continue from the first entry after the last. */
+    uint8_t entry;                  /**< Entry playing. Ignored by SET_PLAYLIST. */
+    zappy_playlist_entry_t entries[PLAYLIST_MAX_ENTRIES];
+} zappy_playlist_t;
+
+typedef struct __packed {
+    uint32_t timestamp;             /**< Host time the element starts, in milliseconds. */
+    zappy_pattern_element_t element;
+} zappy_stream_element_t;
+
+typedef struct __packed {
+    uint16_t latency;               /**< Delay from element timestamps to output, in milliseconds. */
+    uint16_t count;                 /**< Number of elements. */
+    zappy_stream_element_t elements[];
+} zappy_stream_msg_t;
+
+#define STREAM_MSG_MAX_ELEMENTS ((MSG_PAYLOAD_MAX_SIZE - sizeof(zappy_stream_msg_t)) / sizeof(zappy_stream_element_t))
+
+typedef struct __packed {
+    uint16_t accepted;              /**< Elements of the command added to the buffer. */
+    uint16_t depth;                 /**< Elements buffered, including the one playing. */
+    uint16_t buffered;              /**< Output time buffered ahead, in milliseconds. */
+    uint16_t underruns;             /**< Times playback ran out of elements since streaming started. */
+} zappy_stream_status_t;
+
 typedef struct __packed {
     uint32_t pattern_count;
     pattern_index_t patterns_playing[DEVICE_CHANNEL_COUNT];
@@ -0,0 +1,80 @@
+#include "easing.h"
+
+// Curves are sampled at 128 evenly spaced points, plus the end point.
+#define EASING_SAMPLE_BITS 7
+#define EASING_SAMPLES (1 << EASING_SAMPLE_BITS)
+#define EASING_FRAC_BITS (16 - EASING_SAMPLE_BITS)
+
+/*
+ * Curve definitions from https://easings.net, x in [0, 1].
+ * Only evaluated by the compiler to generate tables; GCC folds these builtins to constants.
+ */
+#define PI 3.14159265358979323846
+#define POW(x, y) __builtin_pow((x), (y))
+#define SIN(x) __builtin_sin(x)
+#define COS(x) __builtin_cos(x)
+
+#define SINE_IN(x)          (1 - COS((x) * PI / 2))
+#define SINE_OUT(x)         (SIN((x) * PI / 2))
+#define SINE_IN_OUT(x)      (-(COS(PI * (x)) - 1) / 2)
+#define CUBIC_IN(x)         ((x) * (x) * (x))
+#define CUBIC_OUT(x)        (1 - POW(1 - (x), 3))
+#define CUBIC_IN_OUT(x)     ((x) < 0.5 ? 4 * (x) * (x) * (x) : 1 - POW(-2 * (x) + 2, 3) / 2)
+#define ELASTIC_IN(x)       ((x) == 0 ? 0 : (x) == 1 ? 1 : \
+                             -POW(2, 10 * (x) - 10) * SIN(((x) * 10 - 10.75) * (2 * PI / 3)))
+#define ELASTIC_OUT(x)      ((x) == 0 ? 0 : (x) == 1 ? 1 : \
+                             POW(2, -10 * (x)) * SIN(((x) * 10 - 0.75) * (2 * PI / 3)) + 1)
+#define ELASTIC_IN_OUT(x)   ((x) == 0 ? 0 : (x) == 1 ? 1 : \
+                             (x) < 0.5 ? -POW(2, 20 * (x) - 10) * SIN((20 * (x) - 11.125) * (2 * PI / 4.5)) / 2 \
+                                       : POW(2, -20 * (x) + 10) * SIN((20 * (x) - 11.125) * (2 * PI / 4.5)) / 2 + 1)
+#define BOUNCE_OUT(x)       ((x) < 1 / 2.75 ? 7.5625 * (x) * (x) : \
+                             (x) < 2 / 2.75 ? 7.5625 * ((x) - 1.5 / 2.75) * ((x) - 1.5 / 2.75) + 0.75 : \
+                             (x) < 2.5 / 2.75 ? 7.5625 * ((x) - 2.25 / 2.75) * ((x) - 2.25 / 2.75) + 0.9375 : \
+                             7.5625 * ((x) - 2.625 / 2.75) * ((x) - 2.625 / 2.75) + 0.984375)
+#define BOUNCE_IN(x)        (1 - BOUNCE_OUT(1 - (x)))
+#define BOUNCE_IN_OUT(x)    ((x) < 0.5 ? (1 - BOUNCE_OUT(1 - 2 * (x))) / 2 : (1 + BOUNCE_OUT(2 * (x) - 1)) / 2)
+
+#define SAMPLE(f, i)    ((int16_t) __builtin_lround(f((double) (i) / EASING_SAMPLES) * EASING_ONE))
+#define SAMPLE_8(f, i)  SAMPLE(f, (i) + 0), SAMPLE(f, (i) + 1), SAMPLE(f, (i) + 2), SAMPLE(f, (i) + 3), \
+                        SAMPLE(f, (i) + 4), SAMPLE(f, (i) + 5), SAMPLE(f, (i) + 6), SAMPLE(f, (i) + 7)
+#define EASING_TABLE(f) {                                                       \
+    SAMPLE_8(f, 0), SAMPLE_8(f, 8), SAMPLE_8(f, 16), SAMPLE_8(f, 24),           \
+    SAMPLE_8(f, 32), SAMPLE_8(f, 40), SAMPLE_8(f, 48), SAMPLE_8(f, 56),         \
+    SAMPLE_8(f, 64), SAMPLE_8(f, 72), SAMPLE_8(f, 80), SAMPLE_8(f, 88),         \
+    SAMPLE_8(f, 96), SAMPLE_8(f, 104), SAMPLE_8(f, 112), SAMPLE_8(f, 120),      \
+    SAMPLE(f, EASING_SAMPLES)                                                   \
+}
+
+/// Indexed by easing_function_t. Linear & none are handled without tables.
+static int16_t const easing_tables[EASING_BOUNCE_IN_OUT + 1][EASING_SAMPLES + 1] = {
+    [EASING_SINE_IN]        = EASING_TABLE(SINE_IN),
+    [EASING_SINE_OUT]       = EASING_TABLE(SINE_OUT),
+    [EASING_SINE_IN_OUT]    = EASING_TABLE(SINE_IN_OUT),
+    [EASING_CUBIC_IN]       = EASING_TABLE(CUBIC_IN),
+    [EASING_CUBIC_OUT]      = EASING_TABLE(CUBIC_OUT),
+    [EASING_CUBIC_IN_OUT]   = EASING_TABLE(CUBIC_IN_OUT),
+    [EASING_ELASTIC_IN]     = EASING_TABLE(ELASTIC_IN),
+    [EASING_ELASTIC_OUT]    = EASING_TABLE(ELASTIC_OUT),
+    [EASING_ELASTIC_IN_OUT] = EASING_TABLE(ELASTIC_IN_OUT),
+    [EASING_BOUNCE_IN]      = EASING_TABLE(BOUNCE_IN),
+    [EASING_BOUNCE_OUT]     = EASING_TABLE(BOUNCE_OUT),
+    [EASING_BOUNCE_IN_OUT]  = EASING_TABLE(BOUNCE_IN_OUT),
+};
+
+int32_t ease(easing_function_t easing, uint16_t completion) {
+    switch (easing) {
+        case EASING_LINEAR:
+            return completion >> (16 - 14);
+        case EASING_NONE:
+            return 0;
+        default: {
+            // Reserved functions have no table
+            if (easing > EASING_BOUNCE_IN_OUT) return completion >> (16 - 14);
+            int16_t const *table = easing_tables[easing];
+            uint16_t i = completion >> EASING_FRAC_BITS;
+            int32_t frac = completion & ((1 << EASING_FRAC_BITS) - 1);
+            // Linear interpolation between adjacent samples
+            return table[i] + (((table[i + 1] - table[i]) * frac) >> EASING_FRAC_BITS);
+        }
+    }
+}
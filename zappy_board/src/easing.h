@@ -0,0 +1,26 @@
+#ifndef EASING_H
+#define EASING_H
+
+#include <stdint.h>
+
+#include "patterns.h"
+
+/// Eased completion value equivalent to 1.0
+#define EASING_ONE (1 << 14)
+
+/// Upper bound on the slope of any easing curve, relative to linear.
+#define EASING_MAX_SLOPE 16
+
+/**@brief   Function to apply an easing curve to the completion of a pattern element.
+ *
+ * Curves are sampled into fixed-point tables at compile time and linearly interpolated between samples,
+ * so no floating point is used at runtime.
+ *
+ * @param[in] easing        Easing function of the pattern element.
+ * @param[in] completion    Completion of the pattern element, as a percentage of 0x10000.
+ * @return                  Eased completion, as a percentage of EASING_ONE. Overshooting curves (e.g. elastic)
+ *                          may return values outside of 0 - EASING_ONE.
+ */
+int32_t ease(easing_function_t easing, uint16_t completion);
+
+#endif //EASING_H
@@ -0,0 +1,101 @@
+#include "generator.h"
+#include "easing.h"
+
+#include "nrfx.h"
+
+#define GENERATOR_SEED_SPREAD 0x9E3779B9
+
+/// Phase advance per microsecond for a period in milliseconds. A period of 0 holds the waveform still.
+static uint32_t period_rate(uint16_t period) {
+    return period ? (uint32_t) ((1ULL << GENERATOR_PHASE_BITS) / ((uint32_t) period * 1000)) : 0;
+}
+
+/// Random level within 0 - EASING_ONE.
+static int32_t noise_sample(generator_t *p_gen) {
+    // xorshift32
+    uint32_t x = p_gen->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    p_gen->random_state = x;
+    return (int32_t) (x >> (32 - 14));
+}
+
+void generator_init(generator_t *p_gen, zappy_pattern_generator_t const *p_def) {
+    p_gen->waveform = p_def->control.waveform;
+    p_gen->phase = 0;
+    p_gen->rate = period_rate(p_def->control.period);
+    p_gen->rate_span = 0;
+    p_gen->sweep_duration = 0;
+    if (p_def->control.sweep_period && p_def->control.sweep_duration) {
+        p_gen->rate_span = (int32_t) (period_rate(p_def->control.sweep_period) - p_gen->rate);
+        p_gen->sweep_duration = MIN(p_def->control.sweep_duration, UINT32_MAX / 1000000) * 1000000;
+    }
+    p_gen->sweep_recip = reciprocal(p_gen->sweep_duration);
+    p_gen->sweep_elapsed = 0;
+    // Spread small seeds across all bits, so early samples aren't all near 0
+    p_gen->random_state = p_def->control.seed ? p_def->control.seed * GENERATOR_SEED_SPREAD : GENERATOR_SEED_SPREAD;
+    p_gen->noise_from = 0;
+    p_gen->noise_to = noise_sample(p_gen);
+}
+
+static int32_t generator_level(generator_t const *p_gen) {
+    uint32_t phase = (uint32_t) (p_gen->phase >> (GENERATOR_PHASE_BITS - 16));
+    // Rising for the first half of the period, falling for the second, as a fraction of 0x10000
+    uint16_t fold = MIN((phase < 0x8000 ? phase : 0x10000 - phase) * 2, UINT16_MAX);
+    switch (p_gen->waveform) {
+        case WAVEFORM_SINE:
+            // (1 - cos(pi * x)) / 2 over each half period is a full sine period
+            return ease(EASING_SINE_IN_OUT, fold);
+        case WAVEFORM_TRIANGLE:
+            return fold >> 2;
+        case WAVEFORM_SQUARE:
+            return phase < 0x8000 ? 0 : EASING_ONE;
+        case WAVEFORM_SAW:
+            return phase >> 2;
+        case WAVEFORM_NOISE:
+            return p_gen->noise_from +
+                   (((p_gen->noise_to - p_gen->noise_from) * ease(EASING_SINE_IN_OUT, phase)) >> 14);
+        default:
+            return 0;
+    }
+}
+
+int32_t generator_advance(generator_t *p_gen, uint32_t elapsed) {
+    uint32_t rate = p_gen->rate;
+    if (p_gen->sweep_duration) {
+        // Rate at the middle of the interval integrates a linear sweep exactly
+        uint32_t middle = MIN(p_gen->sweep_elapsed + elapsed / 2, p_gen->sweep_duration);
+        uint32_t sweep = recip_scale(middle, p_gen->sweep_recip.mul, p_gen->sweep_recip.shift, 16);
+        rate += (int32_t) (((int64_t) p_gen->rate_span * sweep) >> 16);
+        p_gen->sweep_elapsed += elapsed;
+        if (p_gen->sweep_elapsed >= p_gen->sweep_duration) {
+            // Restart sweep
+            p_gen->sweep_elapsed %= p_gen->sweep_duration;
+        }
+    }
+    uint64_t phase = p_gen->phase + (uint64_t) rate * elapsed;
+    uint32_t periods = (uint32_t) (phase >> GENERATOR_PHASE_BITS);
+    p_gen->phase = phase & ((1ULL << GENERATOR_PHASE_BITS) - 1);
+    if (periods && p_gen->waveform == WAVEFORM_NOISE) {
+        p_gen->noise_from = periods > 1 ? noise_sample(p_gen) : p_gen->noise_to;
+        p_gen->noise_to = noise_sample(p_gen);
+    }
+    return generator_level(p_gen);
+}
+
+uint16_t generator_progress(generator_t const *p_gen) {
+    if (p_gen->sweep_duration) {
+        return MIN(recip_scale(p_gen->sweep_elapsed, p_gen->sweep_recip.mul, p_gen->sweep_recip.shift, 16),
+                   UINT16_MAX);
+    }
+    return p_gen->phase >> (GENERATOR_PHASE_BITS - 16);
+}
+
+void generator_seek(generator_t *p_gen, uint16_t progress) {
+    if (p_gen->sweep_duration) {
+        p_gen->sweep_elapsed = ((uint64_t) p_gen->sweep_duration * progress) >> 16;
+    } else {
+        p_gen->phase = (uint64_t) progress << (GENERATOR_PHASE_BITS - 16);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+
+#include "patterns.h"
+#include "reciprocal.h"
+
+/// Phase resolution. Periods of 1 ms or more keep rate within 32 bits, with enough precision to not drift.
+#define GENERATOR_PHASE_BITS 40
+
+/**@brief   Waveform generator state, for patterns defined by zappy_pattern_generator_t. */
+typedef struct {
+    pattern_waveform_t waveform;
+    uint64_t phase;                 /**< Position within the current period, as a fraction of 2^GENERATOR_PHASE_BITS. */
+    uint32_t rate;                  /**< Phase advance per microsecond at start of sweep. */
+    int32_t rate_span;              /**< Change in rate from start to end of sweep. */
+    uint32_t sweep_duration;        /**< In microseconds, 0 when not sweeping. */
+    reciprocal_t sweep_recip;       /**< Reciprocal of sweep_duration. */
+    uint32_t sweep_elapsed;         /**< Position within the sweep, in microseconds. */
+    uint32_t random_state;          /**< xorshift32 state for WAVEFORM_NOISE. */
+    int32_t noise_from;             /**< WAVEFORM_NOISE level at start of current period. */
+    int32_t noise_to;               /**< WAVEFORM_NOISE level at end of current period. */
+} generator_t;
+
+/**@brief   Function to initialize generator state from a generator pattern definition. */
+void generator_init(generator_t *p_gen, zappy_pattern_generator_t const *p_def);
+
+/**@brief   Function to advance a generator.
+ *
+ * @param[in] p_gen     Generator state.
+ * @param[in] elapsed   Time to advance by, in microseconds.
+ * @return              Waveform level, as a percentage of EASING_ONE.
+ */
+int32_t generator_advance(generator_t *p_gen, uint32_t elapsed);
+
+/**@brief   Function to get generator position, as a fraction of 0x10000 of the sweep, or period if not sweeping. */
+uint16_t generator_progress(generator_t const *p_gen);
+
+/**@brief   Function to move generator position, the inverse of generator_progress. */
+void generator_seek(generator_t *p_gen, uint16_t progress);
+
+#endif //GENERATOR_H
@@ -0,0 +1,79 @@
+#include <string.h>
+
+#include "interpolator.h"
+
+#include "nrfx.h"
+
+/*
+ * Lanes are packed two per word, integer and fractional halves in separate words, so one 16-bit SIMD add
+ * advances two lanes. Carries out of the fractional halves are recovered from the APSR.GE flags set by UADD16.
+ * Pair 0 = edges 0 & 1, pair 1 = edges 2 & 3, which matches the memory layout of zappy_pulse_t.
+ * Pair 2 = power modulator & an unused lane.
+ */
+#define INTERP_PAIRS ((INTERP_LANES + 1) / 2)
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP && !defined(INTERP_PORTABLE)
+#define INTERP_USE_DSP 1
+#endif
+
+/// Edge-major: each value of all channels is contiguous and word-aligned.
+static struct {
+    uint32_t ints[INTERP_PAIRS][DEVICE_CHANNEL_COUNT];
+    uint32_t fracs[INTERP_PAIRS][DEVICE_CHANNEL_COUNT];
+    uint32_t steps[INTERP_PAIRS * 2][DEVICE_CHANNEL_COUNT];
+} interp;
+
+void interp_seed(uint8_t channel, uint8_t lane, uint32_t value, uint32_t step) {
+    uint8_t pair = lane / 2;
+    uint8_t shift = (lane % 2) * 16;
+    interp.ints[pair][channel] = (interp.ints[pair][channel] & ~(0xFFFFUL << shift)) | ((value >> 16) << shift);
+    interp.fracs[pair][channel] = (interp.fracs[pair][channel] & ~(0xFFFFUL << shift)) | ((value & 0xFFFF) << shift);
+    interp.steps[lane][channel] = step;
+}
+
+#ifdef INTERP_USE_DSP
+
+static inline void advance_pair(uint8_t pair, uint8_t channel, uint32_t step_lo, uint32_t step_hi) {
+    uint32_t step_ints = __PKHTB(step_hi, step_lo, 16);
+    uint32_t step_fracs = __PKHBT(step_lo, step_hi, 16);
+    // Sets GE[1:0] and GE[3:2] on carry out of the low and high halves respectively
+    uint32_t fracs = __UADD16(interp.fracs[pair][channel], step_fracs);
+    uint32_t carries = __SEL(0x00010001, 0);
+    interp.fracs[pair][channel] = fracs;
+    interp.ints[pair][channel] = __UADD16(__UADD16(interp.ints[pair][channel], step_ints), carries);
+}
+
+#else
+
+/// Portable equivalent of the DSP kernel, bit-for-bit identical.
+static inline void advance_pair(uint8_t pair, uint8_t channel, uint32_t step_lo, uint32_t step_hi) {
+    uint32_t ints = interp.ints[pair][channel];
+    uint32_t fracs = interp.fracs[pair][channel];
+    uint32_t lo = ((ints & 0xFFFF) << 16 | (fracs & 0xFFFF)) + step_lo;
+    uint32_t hi = ((ints & 0xFFFF0000) | (fracs >> 16)) + step_hi;
+    interp.ints[pair][channel] = (lo >> 16) | (hi & 0xFFFF0000);
+    interp.fracs[pair][channel] = (lo & 0xFFFF) | (hi << 16);
+}
+
+#endif
+
+void interp_advance(uint8_t channel, uint32_t steps) {
+    if (!steps) return;
+    if (steps == 1) {
+        for (uint8_t pair = 0; pair < INTERP_PAIRS; pair++) {
+            advance_pair(pair, channel, interp.steps[2 * pair][channel], interp.steps[2 * pair + 1][channel]);
+        }
+        return;
+    }
+    for (uint8_t pair = 0; pair < INTERP_PAIRS; pair++) {
+        // Unsigned overflow is intentional, steps are two's complement
+        advance_pair(pair, channel, interp.steps[2 * pair][channel] * steps,
+                     interp.steps[2 * pair + 1][channel] * steps);
+    }
+}
+
+void interp_output(uint8_t channel, zappy_pulse_t pulse, uint16_t *p_power_modulator) {
+    memcpy(pulse, (void *) &interp.ints[0][channel], sizeof(uint32_t));
+    memcpy(&pulse[2], (void *) &interp.ints[1][channel], sizeof(uint32_t));
+    *p_power_modulator = interp.ints[INTERP_POWER_MODULATOR_LANE / 2][channel] & 0xFFFF;
+}
@@ -0,0 +1,28 @@
+#ifndef INTERPOLATOR_H
+#define INTERPOLATOR_H
+
+#include <stdint.h>
+
+#include "app_config.h"
+#include "patterns.h"
+
+/// Interpolated values per channel: the pulse edges followed by the power modulator.
+#define INTERP_LANES (PULSE_EDGES + 1)
+#define INTERP_POWER_MODULATOR_LANE PULSE_EDGES
+
+/**@brief   Function to position an interpolator lane.
+ *
+ * @param[in] channel   Channel of the interpolator.
+ * @param[in] lane      Pulse edge index, or INTERP_POWER_MODULATOR_LANE.
+ * @param[in] value     16.16 fixed point value.
+ * @param[in] step      Two's complement 16.16 change applied per step.
+ */
+void interp_seed(uint8_t channel, uint8_t lane, uint32_t value, uint32_t step);
+
+/**@brief   Function to advance every lane of a channel by a number of steps. Only additions when steps is 1. */
+void interp_advance(uint8_t channel, uint32_t steps);
+
+/**@brief   Function to retrieve the integer part of a channel's interpolated values. */
+void interp_output(uint8_t channel, zappy_pulse_t pulse, uint16_t *p_power_modulator);
+
+#endif //INTERPOLATOR_H
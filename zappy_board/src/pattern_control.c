@@ -4,143 +4,1135 @@
 
 #include "pattern_control.h"
 #include "pulse_control.h"
+#include "easing.h"
+#include "generator.h"
+#include "interpolator.h"
+#include "reciprocal.h"
 #include "prv_utils.h"
 #include "timers.h"
 #include "storage.h"
 #include "display.h"
+#include "playlist.h"
+#include "stream.h"
+
+#ifdef DEBUG
+#include "nrf_log.h"
+#endif
 
 zappy_pattern_adjusts_t pattern_adjusts = {[0 ... _CHANNEL_ARR_MAX] = 0};
 zappy_pattern_progress_t pattern_progress = {0};
 
 pattern_playback_t pattern_playback[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = {0}};
 
-static zappy_pulse_t pulse_cache = {0};
-static uint16_t _power_mod_cache_store = 0;
-static uint16_t *power_mod_cache = &_power_mod_cache_store;
+// Control elements executed to find the next playable element, bounding patterns that only jump between controls.
+#define PATTERN_MAX_CONTROL_STEPS 32
+// Nested PATTERN_OP_LOOPs that can count at once. Further loops are skipped.
+#define PATTERN_MAX_LOOP_DEPTH 4
+#define PATTERN_LOOP_FREE UINT16_MAX
+#define PATTERN_DEFAULT_SEED 0x2545F491
+// Returned by pattern_resolve when control elements never reach a playable element.
+#define PATTERN_NO_ELEMENT UINT16_MAX
 
-static void iter_element(uint8_t channel) {
-    pattern_playback_t *pb = &pattern_playback[channel];
-    pb->element_index++;
-    // Restart if end is reached
-    pb->element_index %= pb->p_pattern->element_count;
-    // Copy pulse to RAM
-    memcpy(pulse_cache, pb->p_pattern->elements[pb->element_index].pulse, sizeof(zappy_pulse_t));
-    *power_mod_cache = pb->p_pattern->elements[pb->element_index].power_modulator;
-    pb->element_start = ms_timestamp();
-}
-
-// Completion is a percentage value * UINT16_MAX.
-static void interpolate_pulse(uint16_t completion,
-                              zappy_pattern_element_t const *p_element,
-                              zappy_pattern_element_t const *p_next_element) {
-    switch (p_element->easing) {
-        case EASING_LINEAR: {
-            // Linear interpolation between subsequent power_modulator values
-            // int32 can accommodate +/- UINT12_MAX * UINT16_MAX
-            int32_t delta_pm = p_next_element->power_modulator - p_element->power_modulator;
-            *power_mod_cache = p_element->power_modulator + ((delta_pm * completion) >> 16);
-
-            // Linear interpolation between each edge of subsequent pulses
-            for (uint8_t i = 0; i < PULSE_EDGES; i++) {
-                uint32_t t0 = p_element->pulse[i];
-                uint32_t t1 = p_next_element->pulse[i];
-                // Cannot use int32 because UINT16_MAX * UINT16_MAX would overflow
-                if (t1 > t0) {
-                    pulse_cache[i] = t0 + (((t1 - t0) * completion) >> 16);
-                } else {
-                    pulse_cache[i] = t0 - (((t0 - t1) * completion) >> 16);
-                }
+/**@brief   Control element interpreter state of a channel. */
+typedef struct {
+    uint16_t restart_index;         /**< Element playback continues from after the last element. */
+    uint16_t repeat_remaining;      /**< Additional plays of the current element. */
+    uint32_t random_state;          /**< xorshift32 state for random branches. */
+    uint16_t passes;                /**< Times playback wrapped past the last element. */
+    struct {
+        uint16_t index;             /**< Element index of the counting PATTERN_OP_LOOP, or PATTERN_LOOP_FREE. */
+        uint16_t remaining;         /**< Jumps left before the loop continues. */
+    } loops[PATTERN_MAX_LOOP_DEPTH];
+    #if PULSE_BURST_MIN_GAP_us
+    uint16_t burst_count;           /**< Sub-pulses per period set by the last PATTERN_OP_BURST. */
+    uint16_t burst_spacing;         /**< Sub-pulse spacing set by the last PATTERN_OP_BURST, in pulse ticks. */
+    #endif
+} pattern_vm_t;
+
+typedef uint16_t (*pattern_op_handler_t)(pattern_vm_t *vm, zappy_pattern_control_t const *p_op, uint16_t index);
+
+/**@brief   Playback plan compiled from a pattern when it starts playing.
+ *
+ * Holds everything update_pulses needs that would otherwise be recomputed every tick. The duration table is
+ * derived from the pattern adjust value and is only rebuilt when pattern_adjusts[channel] changes.
+ */
+typedef struct {
+    zappy_pattern_element_t const *p_element;
+    zappy_pattern_element_t const *p_next_element;
+    uint16_t next_index;
+    bool pass_end;                  /**< Current element is the last of a pass through the pattern. */
+    pattern_vm_t vm;
+    uint16_t count;                 /**< Elements played in sequence, or frames of a multi-track pattern. */
+    uint8_t tracks;                 /**< Track count of a multi-track pattern, 0 for single track patterns. */
+    uint8_t track;                  /**< Track of a multi-track pattern played by the channel. */
+    bool generator;                 /**< Pattern output comes from gen rather than element sequence. */
+    generator_t gen;
+    uint32_t gen_speed;             /**< ADJUST_PLAYBACK_SPEED multiplier of generator rate, as a 16.16 value. */
+    uint32_t gen_time;              /**< Timestamp generator was last advanced to. */
+    uint32_t step_interval;         /**< Time for current element output to change by one unit, in microseconds. */
+    uint32_t deadline;              /**< Timestamp of next output change, used by deadline scheduling. */
+    uint16_t adjust;                /**< Pattern adjust value currently applied. */
+    uint16_t ends_adjust;           /**< Pattern adjust value the duration tables were built for. */
+    uint32_t offset_scale;          /**< ADJUST_PULSE_PERIOD: adjust / MAX_PATTERN_ADJUST, as a 16.16 value. */
+    reciprocal_t total_recip;       /**< Reciprocal of adjusted pattern duration, for pattern progress. */
+    uint32_t ends[MAX_PATTERN_ELEMENT_COUNT];   /**< Prefix sums of adjusted durations in milliseconds, for seeking. */
+    reciprocal_t element_recip;     /**< Reciprocal of the current element's adjusted duration, for completion. */
+    uint32_t interp_elapsed;        /**< Element time the interpolator was last stepped to, in milliseconds. */
+    zappy_pulse_t pulse;            /**< Interpolated pulse output. */
+    uint16_t power_modulator;       /**< Interpolated power modulator output. */
+    #if PULSE_BURST_MIN_GAP_us
+    uint16_t burst_count;           /**< Sub-pulses per period of the current element. */
+    uint16_t burst_spacing;         /**< Sub-pulse spacing of the current element, in pulse ticks. */
+    #endif
+    uint32_t started;               /**< Timestamp pattern started playing. */
+    uint32_t fade_start;            /**< Timestamp crossfade from the previous pattern started. */
+    uint32_t fade_duration;         /**< Crossfade duration in microseconds, 0 when not fading. */
+    reciprocal_t fade_recip;        /**< Reciprocal of fade_duration. */
+    zappy_pulse_t fade_pulse;       /**< Pulse output of the previous pattern when the crossfade started. */
+    uint16_t fade_power_modulator;  /**< Power modulator output of the previous pattern when the crossfade started. */
+    #if PATTERN_INTERPOLATE_PER_PULSE
+    uint32_t pulse_elapsed;         /**< Pulse periods played of current element, in microseconds. */
+    uint32_t pulse_duration;        /**< Adjusted current element duration, in microseconds. */
+    reciprocal_t pulse_recip;       /**< Reciprocal of pulse_duration, the element completion slope. */
+    #endif
+} pattern_plan_t;
+
+/**@brief   Pattern switched to after the current one, with its plan compiled ahead of time. */
+typedef struct {
+    zappy_pattern_t *p_pattern;     /**< NULL when nothing is queued. */
+    uint16_t pattern_index;
+    uint16_t element_index;         /**< First element played. */
+    uint16_t passes;                /**< Passes through the current pattern before switching, 0 to switch by time. */
+    uint32_t length;                /**< Time from current pattern start to switch, in microseconds. */
+    uint32_t crossfade;             /**< Crossfade duration, in microseconds. 0 for gapless. */
+} pattern_queue_t;
+
+// Two plans per channel: one playing, the other compiled ahead of time for the queued pattern.
+static pattern_plan_t plan_pool[2][DEVICE_CHANNEL_COUNT];
+// Which of plan_pool is playing, per channel. Switching patterns flips it in a single write.
+static uint8_t volatile active_plans[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = 0};
+static pattern_queue_t pattern_queues[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = {0}};
+
+#if PATTERN_LAYER_COUNT
+/**@brief   Pattern layered on top of a channel's main pattern.
+ *
+ * Layers are evaluated directly from element completion, so they don't need interpolator state of their own.
+ */
+typedef struct {
+    zappy_pattern_t *p_pattern;     /**< NULL when the layer isn't playing. */
+    uint16_t pattern_index;
+    uint16_t element_index;
+    uint32_t element_start;         /**< us_timestamp of the scheduled start of the current element. */
+    layer_edge_mix_t edges;
+    layer_power_mix_t power;
+    pattern_plan_t plan;
+} pattern_layer_t;
+
+static pattern_layer_t pattern_layers[PATTERN_LAYER_COUNT][DEVICE_CHANNEL_COUNT];
+#endif
+
+// Update interval while crossfading, the same as the update timer.
+#define PATTERN_FADE_INTERVAL_us (1000000 / UPDATE_TIMER_FREQ_Hz)
+
+static inline pattern_plan_t *channel_plan(uint8_t channel) {
+    return &plan_pool[active_plans[channel]][channel];
+}
+
+static inline pattern_plan_t *queued_plan(uint8_t channel) {
+    return &plan_pool[!active_plans[channel]][channel];
+}
+
+#ifdef DEBUG
+// Cycles spent in the most recent and the slowest call to update_pulses.
+static uint32_t volatile update_pulses_cycles = 0;
+static uint32_t volatile update_pulses_cycles_max = 0;
+#endif
+
+static uint32_t adjusted_duration(zappy_pattern_t const *p_pattern, uint16_t adj, uint16_t duration) {
+    switch (p_pattern->pattern_adjust.algorithm) {
+        case ADJUST_PLAYBACK_SPEED: {
+            // TODO: Change parameter interpretation algorithm.
+            //      Pattern adjust should only increase playback speed, because intensity scales with speed.
+            //      Keep general curve shape, but have the adjust parameter control the max speed multiplier.
+            //      Allowing pattern adjust to slow patterns down isn't useful.
+
+            // Scale up pattern adjust parameter to uint16 range
+            uint16_t adj_offset = (p_pattern->pattern_adjust.parameters << 4);
+            int32_t offset = adj - adj_offset;
+            uint32_t offset_squared = offset * offset;
+            uint32_t scaler;
+            if (adj_offset > HALF_PATTERN_ADJUST) {
+                scaler = (4 * (uint32_t) adj_offset) / 7 - (offset_squared / 2) / adj_offset;
+            } else {
+                scaler = (4 * (uint32_t) (MAX_PATTERN_ADJUST - adj_offset)) / 7 -
+                         (offset_squared / 2) / (MAX_PATTERN_ADJUST - adj_offset);
+            }
+            if (offset < 0) {
+                // Slow pattern down. Want a positive duration, so subtract offset
+                return (scaler - offset) * duration / scaler;
+            } else {
+                // Speed pattern up.
+                return scaler * duration / (scaler + offset);
             }
         }
-            break;
+        case ADJUST_PULSE_PERIOD:
         default:
-        case EASING_NONE:
-            // Update caches with unmodified pattern element values.
-            *power_mod_cache = p_element->power_modulator;
-            for (uint8_t i = 0; i < PULSE_EDGES; i++) {
-                pulse_cache[i] = p_element->pulse[i];
+        case ADJUST_IGNORED:
+            return duration;
+    }
+}
+
+static inline uint32_t adjusted_duration_us(zappy_pattern_t const *p_pattern, uint16_t adj, uint16_t duration) {
+    return MIN(adjusted_duration(p_pattern, adj, duration), UINT32_MAX / 1000) * 1000;
+}
+
+/// Largest change between two elements, which sets the rate at which output changes.
+static uint32_t element_max_delta(zappy_pattern_element_t const *p_element,
+                                  zappy_pattern_element_t const *p_next_element) {
+    uint32_t max_delta = abs(p_next_element->power_modulator - p_element->power_modulator);
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        max_delta = MAX(max_delta, abs(p_next_element->pulse[i] - p_element->pulse[i]));
+    }
+    return max_delta;
+}
+
+/// Generator definition of a pattern, or NULL if the pattern plays its elements in sequence.
+static zappy_pattern_generator_t const *pattern_generator(zappy_pattern_t const *p_pattern) {
+    if (p_pattern->version.major < ZAPPY_PATTERN_VERSION_CONTROL_ELEMENTS || p_pattern->element_count < 3) {
+        return NULL;
+    }
+    zappy_pattern_generator_t const *p_def = (zappy_pattern_generator_t const *) p_pattern->elements;
+    if (p_def->control.duration || p_def->control.opcode != PATTERN_OP_GENERATOR) return NULL;
+    return p_def;
+}
+
+/// Track count of a multi-track pattern, or 0 if the pattern has a single track.
+static uint16_t pattern_tracks(zappy_pattern_t const *p_pattern) {
+    if (p_pattern->version.major < ZAPPY_PATTERN_VERSION_CONTROL_ELEMENTS || !p_pattern->element_count) return 0;
+    zappy_pattern_tracks_t const *p_def = (zappy_pattern_tracks_t const *) p_pattern->elements;
+    if (p_def->duration || p_def->opcode != PATTERN_OP_TRACKS) return 0;
+    return p_def->tracks;
+}
+
+/// PATTERN_OP_RESOLUTION element ending a pattern, or NULL if its pulse values count microseconds.
+static zappy_pattern_control_t const *pattern_resolution_op(zappy_pattern_t const *p_pattern) {
+    if (p_pattern->version.major < ZAPPY_PATTERN_VERSION_CONTROL_ELEMENTS || p_pattern->element_count < 2) return NULL;
+    zappy_pattern_control_t const *p_op =
+            (zappy_pattern_control_t const *) &p_pattern->elements[p_pattern->element_count - 1];
+    if (p_op->duration || p_op->opcode != PATTERN_OP_RESOLUTION) return NULL;
+    return p_op;
+}
+
+/// Length of the ticks a pattern's pulse values count.
+static pulse_resolution_t pattern_resolution(zappy_pattern_t const *p_pattern) {
+    zappy_pattern_control_t const *p_op = pattern_resolution_op(p_pattern);
+    return p_op && p_op->param < PULSE_RESOLUTION_COUNT ? p_op->param : PULSE_RESOLUTION_1_US;
+}
+
+/// Frames of a multi-track pattern, which exclude its header and resolution elements.
+static uint16_t pattern_frames(zappy_pattern_t const *p_pattern, uint16_t tracks) {
+    return (p_pattern->element_count - 1 - (pattern_resolution_op(p_pattern) != NULL)) / tracks;
+}
+
+/// Element of a channel's track at index, which counts frames for multi-track patterns.
+static inline zappy_pattern_element_t const *plan_track_element(pattern_plan_t const *plan,
+                                                                zappy_pattern_t const *p_pattern,
+                                                                uint16_t index, uint8_t track) {
+    if (!plan->tracks) return &p_pattern->elements[index];
+    return &p_pattern->elements[1 + index * plan->tracks + track];
+}
+
+/// Channels playing the tracks of the multi-track pattern whose track 0 plays on channel, including channel.
+static uint32_t plan_track_channels(uint8_t channel) {
+    uint32_t channels = 1UL << channel;
+    zappy_pattern_t const *p_pattern = pattern_playback[channel].p_pattern;
+    for (uint8_t track = 1; track < channel_plan(channel)->tracks && channel + track < DEVICE_CHANNEL_COUNT; track++) {
+        uint8_t follower = channel + track;
+        if (channel_plan(follower)->track == track && pattern_playback[follower].p_pattern == p_pattern) {
+            channels |= 1UL << follower;
+        }
+    }
+    return channels;
+}
+
+/// Derives generator speed and update interval from the pattern adjust value.
+static void plan_generator_rate(pattern_plan_t *plan, zappy_pattern_t const *p_pattern) {
+    zappy_pattern_generator_t const *p_def = (zappy_pattern_generator_t const *) p_pattern->elements;
+    uint32_t reference = MAX(p_def->low.duration, 1);
+    uint32_t adjusted = MAX(adjusted_duration(p_pattern, plan->adjust, reference), 1);
+    plan->gen_speed = (reference << 16) / adjusted;
+    // Waveforms change by at most 4x the low to high difference per period
+    uint32_t max_delta = element_max_delta(&p_def->low, &p_def->high) * 4;
+    uint32_t period = p_def->control.period;
+    if (p_def->control.sweep_period) period = MIN(period, p_def->control.sweep_period);
+    plan->step_interval = UINT32_MAX;
+    if (max_delta && period) {
+        uint64_t adjusted_period = (uint64_t) period * 1000 * adjusted / reference;
+        plan->step_interval = MAX(MIN(adjusted_period / max_delta, UINT32_MAX), PATTERN_MIN_UPDATE_INTERVAL_us);
+    }
+}
+
+/// Time from pattern start to the start of an element, in milliseconds.
+static inline uint32_t plan_begin(pattern_plan_t const *plan, uint16_t element_index) {
+    return element_index ? plan->ends[element_index - 1] : 0;
+}
+
+/// Adjusted element duration, in microseconds.
+static inline uint32_t plan_duration(pattern_plan_t const *plan, uint16_t element_index) {
+    return (plan->ends[element_index] - plan_begin(plan, element_index)) * 1000;
+}
+
+/// Rebuild the adjusted duration tables of a plan.
+static void plan_ends(pattern_plan_t *plan, zappy_pattern_t const *p_pattern, uint16_t adj) {
+    uint32_t end = 0;
+    // Tracks all follow the durations of track 0
+    for (uint16_t i = 0; i < plan->count; i++) {
+        uint32_t duration = adjusted_duration_us(p_pattern, adj, plan_track_element(plan, p_pattern, i, 0)->duration);
+        end += duration / 1000;
+        plan->ends[i] = end;
+    }
+    plan->total_recip = reciprocal(end);
+    plan->ends_adjust = adj;
+}
+
+/// Rebuild the adjust-derived parts of a plan. Only called when the pattern adjust value changes.
+static void plan_adjust(pattern_plan_t *plan, zappy_pattern_t const *p_pattern, uint16_t adj) {
+    plan_ends(plan, p_pattern, adj);
+    plan->offset_scale = ((uint32_t) adj << 16) / MAX_PATTERN_ADJUST;
+    plan->adjust = adj;
+    if (plan->generator) plan_generator_rate(plan, p_pattern);
+}
+
+/// Time progress through the pattern, as a fraction of 0x10000.
+static uint16_t plan_progress(pattern_plan_t const *plan, uint16_t element_index, uint32_t elapsed) {
+    uint32_t position = plan_begin(plan, element_index) + MIN(elapsed, plan_duration(plan, element_index)) / 1000;
+    return MIN(recip_scale(position, plan->total_recip.mul, plan->total_recip.shift, 16), UINT16_MAX);
+}
+
+/// Derives the current element's duration reciprocal & update interval, as it's entered or its duration changes.
+static void plan_step_interval(pattern_plan_t *plan, uint16_t element_index) {
+    zappy_pattern_element_t const *p_element = plan->p_element;
+    plan->element_recip = reciprocal(plan_duration(plan, element_index));
+    plan->step_interval = UINT32_MAX;
+    // Elements without duration are stepped past rather than played
+    if (p_element->easing == EASING_NONE || !plan_duration(plan, element_index)) return;
+    uint32_t max_delta = element_max_delta(p_element, plan->p_next_element);
+    // Eased curves change faster than linear for part of the element
+    if (p_element->easing != EASING_LINEAR) max_delta *= EASING_MAX_SLOPE;
+    if (max_delta) {
+        plan->step_interval = MAX(plan_duration(plan, element_index) / max_delta, PATTERN_MIN_UPDATE_INTERVAL_us);
+    }
+}
+
+static uint16_t op_jump(pattern_vm_t __unused *vm, zappy_pattern_control_t const *p_op, uint16_t __unused index) {
+    return p_op->args[0];
+}
+
+static uint16_t op_loop(pattern_vm_t *vm, zappy_pattern_control_t const *p_op, uint16_t index) {
+    if (!p_op->args[1]) return p_op->args[0];
+    uint8_t free = PATTERN_MAX_LOOP_DEPTH;
+    for (uint8_t i = 0; i < PATTERN_MAX_LOOP_DEPTH; i++) {
+        if (vm->loops[i].index == index) {
+            if (vm->loops[i].remaining) {
+                vm->loops[i].remaining--;
+                return p_op->args[0];
             }
+            // Loop finished, release counter
+            vm->loops[i].index = PATTERN_LOOP_FREE;
+            return index + 1;
+        }
+        if (vm->loops[i].index == PATTERN_LOOP_FREE) free = i;
+    }
+    if (free == PATTERN_MAX_LOOP_DEPTH) return index + 1;   // Nested too deep
+    vm->loops[free].index = index;
+    vm->loops[free].remaining = p_op->args[1] - 1;
+    return p_op->args[0];
+}
+
+static uint16_t op_repeat(pattern_vm_t *vm, zappy_pattern_control_t const *p_op, uint16_t index) {
+    vm->repeat_remaining = p_op->args[0];
+    return index + 1;
+}
+
+static uint16_t op_loop_start(pattern_vm_t *vm, zappy_pattern_control_t const __unused *p_op, uint16_t index) {
+    vm->restart_index = index + 1;
+    return index + 1;
+}
+
+static uint16_t op_random(pattern_vm_t *vm, zappy_pattern_control_t const *p_op, uint16_t index) {
+    // xorshift32
+    uint32_t x = vm->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    vm->random_state = x;
+    return (x >> 16) < p_op->args[1] ? p_op->args[0] : index + 1;
+}
+
+static uint16_t op_seed(pattern_vm_t *vm, zappy_pattern_control_t const *p_op, uint16_t index) {
+    uint32_t seed = ((uint32_t) p_op->args[1] << 16) | p_op->args[0];
+    // xorshift state must be non-zero
+    vm->random_state = seed ? seed : PATTERN_DEFAULT_SEED;
+    return index + 1;
+}
+
+#if PULSE_BURST_MIN_GAP_us
+static uint16_t op_burst(pattern_vm_t *vm, zappy_pattern_control_t const *p_op, uint16_t index) {
+    vm->burst_count = p_op->args[0];
+    vm->burst_spacing = p_op->args[1];
+    return index + 1;
+}
+#endif
+
+static pattern_op_handler_t const op_handlers[PATTERN_OP_COUNT] = {
+    [PATTERN_OP_JUMP] = op_jump,
+    [PATTERN_OP_LOOP] = op_loop,
+    [PATTERN_OP_REPEAT] = op_repeat,
+    [PATTERN_OP_LOOP_START] = op_loop_start,
+    [PATTERN_OP_RANDOM] = op_random,
+    [PATTERN_OP_SEED] = op_seed,
+    #if PULSE_BURST_MIN_GAP_us
+    [PATTERN_OP_BURST] = op_burst,
+    #endif
+};
+
+static void vm_reset_loops(pattern_vm_t *vm) {
+    vm->repeat_remaining = 0;
+    for (uint8_t i = 0; i < PATTERN_MAX_LOOP_DEPTH; i++) {
+        vm->loops[i].index = PATTERN_LOOP_FREE;
+    }
+}
+
+static void vm_reset(pattern_vm_t *vm) {
+    vm->restart_index = 0;
+    vm->random_state = PATTERN_DEFAULT_SEED;
+    vm->passes = 0;
+    #if PULSE_BURST_MIN_GAP_us
+    vm->burst_count = 1;
+    vm->burst_spacing = 0;
+    #endif
+    vm_reset_loops(vm);
+}
+
+/**@brief   Executes control elements from index until reaching an element that plays.
+ *
+ * @return  Index of a playable element, or PATTERN_NO_ELEMENT if PATTERN_MAX_CONTROL_STEPS were executed first.
+ */
+static uint16_t pattern_resolve(pattern_vm_t *vm, zappy_pattern_t const *p_pattern, uint16_t index) {
+    for (uint8_t steps = 0; steps < PATTERN_MAX_CONTROL_STEPS; steps++) {
+        if (index >= p_pattern->element_count) {
+            // Each pass through the pattern starts with fresh loop counts
+            index = vm->restart_index;
+            vm_reset_loops(vm);
+            vm->passes++;
+        }
+        zappy_pattern_control_t const *p_op = (zappy_pattern_control_t const *) &p_pattern->elements[index];
+        if (p_op->duration) return index;
+        // Unknown opcodes, and those describing the whole pattern, are skipped
+        pattern_op_handler_t handler = p_op->opcode < PATTERN_OP_COUNT ? op_handlers[p_op->opcode] : NULL;
+        index = handler ? handler(vm, p_op, index) : index + 1;
+    }
+    return PATTERN_NO_ELEMENT;
+}
+
+/// Finds the element played after element_index, running any control elements in between.
+static uint16_t pattern_next(pattern_plan_t *plan, zappy_pattern_t const *p_pattern, uint16_t element_index) {
+    if (p_pattern->version.major < ZAPPY_PATTERN_VERSION_CONTROL_ELEMENTS || plan->tracks) {
+        // Next index wraps to restart when end is reached
+        if (element_index + 1 < plan->count) return element_index + 1;
+        plan->vm.passes++;
+        return 0;
+    }
+    pattern_vm_t *vm = &plan->vm;
+    if (vm->repeat_remaining) {
+        vm->repeat_remaining--;
+        return element_index;
+    }
+    uint16_t next_index = pattern_resolve(vm, p_pattern, element_index + 1);
+    // Hold the current element rather than play a control element
+    return next_index == PATTERN_NO_ELEMENT ? element_index : next_index;
+}
+
+/// Finds the first element played, resetting interpreter state.
+static uint16_t pattern_first(pattern_plan_t *plan, zappy_pattern_t const *p_pattern) {
+    pattern_vm_t *vm = &plan->vm;
+    vm_reset(vm);
+    if (p_pattern->version.major < ZAPPY_PATTERN_VERSION_CONTROL_ELEMENTS || plan->tracks) return 0;
+    return pattern_resolve(vm, p_pattern, 0);
+}
+
+static void plan_element(pattern_plan_t *plan, zappy_pattern_t const *p_pattern, uint16_t element_index) {
+    #if PULSE_BURST_MIN_GAP_us
+    // Taken before resolving ahead, as control elements after this one only apply to later elements
+    plan->burst_count = plan->vm.burst_count;
+    plan->burst_spacing = plan->vm.burst_spacing;
+    #endif
+    // Resolved on entry, so interpolation heads towards the element that actually plays next
+    uint16_t passes = plan->vm.passes;
+    plan->next_index = pattern_next(plan, p_pattern, element_index);
+    plan->pass_end = plan->vm.passes != passes;
+    plan->p_element = plan_track_element(plan, p_pattern, element_index, plan->track);
+    plan->p_next_element = plan_track_element(plan, p_pattern, plan->next_index, plan->track);
+    plan_step_interval(plan, element_index);
+}
+
+static inline uint16_t element_value(zappy_pattern_element_t const *p_element, uint8_t i) {
+    return i < PULSE_EDGES ? p_element->pulse[i] : p_element->power_modulator;
+}
+
+/// Computes interpolator deltas for the current element and positions it at elapsed microseconds.
+static void plan_interp(uint8_t channel, uint32_t elapsed) {
+    pattern_plan_t *plan = channel_plan(channel);
+    // Interpolator steps once per millisecond
+    elapsed /= 1000;
+    uint16_t element_index = pattern_playback[channel].element_index;
+    bool linear = plan->p_element->easing == EASING_LINEAR && plan_duration(plan, element_index);
+    for (uint8_t i = 0; i < INTERP_LANES; i++) {
+        uint16_t v0 = element_value(plan->p_element, i);
+        uint16_t v1 = element_value(plan->p_next_element, i);
+        uint32_t step = 0;
+        if (linear) {
+            // Same as ((v1 - v0) << 16) / (duration / 1000), using the duration reciprocal
+            step = recip_scale((v1 > v0 ? v1 - v0 : v0 - v1) * 1000, plan->element_recip.mul,
+                               plan->element_recip.shift, 16);
+            if (v1 < v0) step = -step;
+        }
+        // Offset by 0.5 so truncation rounds. Unsigned overflow of step is intentional.
+        interp_seed(channel, i, ((uint32_t) v0 << 16) + 0x8000 + step * elapsed, step);
+    }
+    plan->interp_elapsed = elapsed;
+    interp_output(channel, plan->pulse, &plan->power_modulator);
+}
+
+/// Steps the interpolator forward to elapsed microseconds.
+static void plan_interp_advance(uint8_t channel, uint32_t elapsed) {
+    pattern_plan_t *plan = channel_plan(channel);
+    elapsed /= 1000;
+    interp_advance(channel, elapsed - plan->interp_elapsed);
+    plan->interp_elapsed = elapsed;
+    interp_output(channel, plan->pulse, &plan->power_modulator);
+}
+
+/// Mixes current and next element by level, a percentage of EASING_ONE, clamping levels that overshoot.
+static void plan_mix(pattern_plan_t *plan, int32_t level) {
+    for (uint8_t i = 0; i < INTERP_LANES; i++) {
+        int32_t v0 = element_value(plan->p_element, i);
+        int32_t v1 = element_value(plan->p_next_element, i);
+        int32_t value = v0 + (((v1 - v0) * level) >> 14);
+        value = MAX(value, 0);
+        if (i < PULSE_EDGES) {
+            plan->pulse[i] = MIN(value, UINT16_MAX);
+        } else {
+            plan->power_modulator = MIN(value, POWER_MOD_MAX);
+        }
+    }
+}
+
+/// Linearly interpolates the current element at completion, a 0.16 fixed point fraction of its duration.
+static void plan_lerp(pattern_plan_t *plan, uint16_t completion) {
+    for (uint8_t i = 0; i < INTERP_LANES; i++) {
+        int32_t v0 = element_value(plan->p_element, i);
+        int32_t v1 = element_value(plan->p_next_element, i);
+        int32_t value = v0 + (int32_t) (((int64_t) (v1 - v0) * completion) >> 16);
+        if (i < PULSE_EDGES) {
+            plan->pulse[i] = value;
+        } else {
+            plan->power_modulator = value;
+        }
+    }
+}
+
+/// Evaluates eased (non-linear) elements from completion.
+static void interp_ease(pattern_plan_t *plan, uint16_t completion) {
+    plan_mix(plan, ease(plan->p_element->easing, completion));
+}
+
+/// Whether a channel's queued pattern is due by time, its length after the current pattern started.
+static inline bool pattern_switch_timed(uint8_t channel, uint32_t now) {
+    pattern_queue_t const *q = &pattern_queues[channel];
+    return q->p_pattern && !q->passes && now - channel_plan(channel)->started >= q->length;
+}
+
+/// Whether a channel's queued pattern is due at the end of the current element, by passes through the pattern.
+static inline bool pattern_switch_pass(uint8_t channel) {
+    pattern_queue_t const *q = &pattern_queues[channel];
+    pattern_plan_t const *plan = channel_plan(channel);
+    return q->p_pattern && q->passes && plan->pass_end && plan->vm.passes >= q->passes;
+}
+
+/// Limits the wait until a channel next updates by its queued pattern and crossfade.
+static uint32_t pattern_switch_wait(uint8_t channel, uint32_t now, uint32_t wait) {
+    pattern_queue_t const *q = &pattern_queues[channel];
+    pattern_plan_t const *plan = channel_plan(channel);
+    if (q->p_pattern && !q->passes) wait = MIN(wait, plan->started + q->length - now);
+    if (plan->fade_duration) wait = MIN(wait, PATTERN_FADE_INTERVAL_us);
+    return wait;
+}
+
+/**@brief   Switches a channel to its queued pattern, whose plan was compiled when it was queued.
+ *
+ * @param[in] channel   Channel to switch.
+ * @param[in] start     Timestamp the queued pattern starts from, where the outgoing pattern ended.
+ * @param[in] now       Current timestamp.
+ */
+static void pattern_switch(uint8_t channel, uint32_t start, uint32_t now) {
+    pattern_queue_t *q = &pattern_queues[channel];
+    pattern_playback_t *pb = &pattern_playback[channel];
+    pattern_plan_t const *outgoing = channel_plan(channel);
+    pattern_plan_t *plan = queued_plan(channel);
+    plan->fade_duration = q->crossfade;
+    if (q->crossfade) {
+        // Fade from wherever the outgoing pattern got to, including part way through a crossfade of its own
+        memcpy(plan->fade_pulse, outgoing->pulse, sizeof(zappy_pulse_t));
+        plan->fade_power_modulator = outgoing->power_modulator;
+        plan->fade_start = start;
+        plan->fade_recip = reciprocal(q->crossfade);
+    }
+    plan->started = start;
+    plan->gen_time = start;
+    active_plans[channel] ^= 1;
+    pb->pattern_index = q->pattern_index;
+    pb->element_index = q->element_index;
+    pb->element_start = start;
+    pb->p_pattern = q->p_pattern;
+    q->p_pattern = NULL;
+    plan_interp(channel, now - start);
+    APP_ERROR_CHECK(app_sched_event_put(&channel, sizeof(channel), SCHED_FN(playlist_pattern_switched)));
+}
+
+/**@brief   Moves a channel on to the element playing at now.
+ *
+ * Element start times accumulate from scheduled durations rather than from when expiry was noticed, so element
+ * boundaries don't drift by the update latency. Runs of elements without duration are stepped through in the same
+ * call, bounded by a pass through the pattern, so a pattern with no duration at all holds its element instead of
+ * re-arming the pattern timer for every one. Other tracks of a multi-track pattern jump straight to the frame found
+ * for track 0.
+ */
+static void iter_element(uint8_t channel, uint32_t now) {
+    pattern_playback_t *pb = &pattern_playback[channel];
+    pattern_plan_t *plan = channel_plan(channel);
+    uint16_t skipped = 0;
+    do {
+        pb->element_start += plan_duration(plan, pb->element_index);
+        if (pattern_switch_pass(channel)) {
+            // Gapless, the queued pattern starts exactly where the pass ended
+            pattern_switch(channel, pb->element_start, now);
+            plan = channel_plan(channel);
+        } else {
+            pb->element_index = plan->next_index;
+            plan_element(plan, pb->p_pattern, pb->element_index);
+        }
+    } while (now - pb->element_start >= plan_duration(plan, pb->element_index) &&
+             ++skipped < plan->count);
+    if (skipped == plan->count) {
+        // More than a full pass behind, e.g. channel was paused. Restart the element instead of racing to catch up.
+        pb->element_start = now;
+    }
+    plan_interp(channel, now - pb->element_start);
+    uint32_t followers = plan_track_channels(channel) & ~(1UL << channel);
+    for (uint8_t follower = channel + 1; followers >> follower; follower++) {
+        if (!(followers & (1UL << follower))) continue;
+        pattern_playback[follower].element_index = pb->element_index;
+        pattern_playback[follower].element_start = pb->element_start;
+        plan_element(channel_plan(follower), pb->p_pattern, pb->element_index);
+        plan_interp(follower, now - pb->element_start);
+    }
+}
+
+/// Mixes the previous pattern's output into the plan output by level, a 0.16 fixed point fraction.
+static void plan_fade(pattern_plan_t *plan, uint16_t level) {
+    for (uint8_t i = 0; i < INTERP_LANES; i++) {
+        int32_t from = i < PULSE_EDGES ? plan->fade_pulse[i] : plan->fade_power_modulator;
+        int32_t to = i < PULSE_EDGES ? plan->pulse[i] : plan->power_modulator;
+        int32_t value = from + (int32_t) (((int64_t) (to - from) * level) >> 16);
+        if (i < PULSE_EDGES) {
+            plan->pulse[i] = value;
+        } else {
+            plan->power_modulator = value;
+        }
+    }
+}
+
+#if PATTERN_LAYER_COUNT
+/// Moves a layer to its output at now. Follows the channel's pattern adjust value, and steps elements drift-free.
+static void layer_evaluate(uint8_t channel, pattern_layer_t *layer, uint32_t now) {
+    pattern_plan_t *plan = &layer->plan;
+    #if !PATTERN_INTERPOLATE_PER_PULSE
+    // Per-pulse playback evaluates layers within the pulse interrupt, too often to rebuild duration tables, so layers
+    // keep the adjust value they started with.
+    uint16_t adj = pattern_adjusts[channel];
+    if (adj != plan->adjust) {
+        plan_adjust(plan, layer->p_pattern, adj);
+        plan_step_interval(plan, layer->element_index);
+    }
+    #endif
+    if (plan->generator) {
+        plan_mix(plan, generator_advance(&plan->gen, ((uint64_t) (now - plan->gen_time) * plan->gen_speed) >> 16));
+        plan->gen_time = now;
+        return;
+    }
+    uint16_t skipped = 0;
+    while (now - layer->element_start >= plan_duration(plan, layer->element_index)) {
+        if (++skipped > plan->count) {
+            // More than a full pass behind, restart the element instead of racing to catch up.
+            layer->element_start = now;
+            break;
+        }
+        layer->element_start += plan_duration(plan, layer->element_index);
+        layer->element_index = plan->next_index;
+        plan_element(plan, layer->p_pattern, layer->element_index);
+    }
+    uint32_t elapsed = now - layer->element_start;
+    uint16_t completion = 0;
+    if (elapsed < plan_duration(plan, layer->element_index)) {
+        completion = recip_scale(elapsed, plan->element_recip.mul, plan->element_recip.shift, 16);
+    }
+    switch (plan->p_element->easing) {
+        case EASING_NONE:
+            plan_lerp(plan, 0);
+            break;
+        case EASING_LINEAR:
+            plan_lerp(plan, completion);
+            break;
+        default:
+            interp_ease(plan, completion);
+            break;
+    }
+}
+
+/// Combines a layer's output into the output beneath it, by the layer's mix rules.
+static void layer_mix(pattern_plan_t *plan, pattern_layer_t const *layer) {
+    pattern_plan_t const *top = &layer->plan;
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        switch (layer->edges) {
+            case LAYER_EDGES_OVERRIDE:
+                plan->pulse[i] = top->pulse[i];
+                break;
+            case LAYER_EDGES_MIN:
+                plan->pulse[i] = MIN(plan->pulse[i], top->pulse[i]);
+                break;
+            case LAYER_EDGES_MAX:
+                plan->pulse[i] = MAX(plan->pulse[i], top->pulse[i]);
+                break;
+            case LAYER_EDGES_KEEP:
+            default:
+                break;
+        }
+    }
+    switch (layer->power) {
+        case LAYER_POWER_OVERRIDE:
+            plan->power_modulator = top->power_modulator;
+            break;
+        case LAYER_POWER_MULTIPLY:
+            // Output power is channel power * (POWER_MOD_MAX - power_modulator) / POWER_MOD_MAX
+            plan->power_modulator = POWER_MOD_MAX - (uint32_t) (POWER_MOD_MAX - plan->power_modulator) *
+                                                    (POWER_MOD_MAX - top->power_modulator) / POWER_MOD_MAX;
+            break;
+        case LAYER_POWER_KEEP:
+        default:
             break;
     }
 }
 
-void update_pulses(void) {
+/// Limits the wait until a channel next updates by when the output of its layers next changes.
+static uint32_t layers_wait(uint8_t channel, uint32_t now, uint32_t wait) {
+    for (uint8_t i = 0; i < PATTERN_LAYER_COUNT; i++) {
+        pattern_layer_t const *layer = &pattern_layers[i][channel];
+        if (!layer->p_pattern) continue;
+        pattern_plan_t const *plan = &layer->plan;
+        wait = MIN(wait, plan->step_interval);
+        if (!plan->generator) {
+            uint32_t elapsed = now - layer->element_start;
+            uint32_t duration = plan_duration(plan, layer->element_index);
+            // Layers with no element duration hold, see iter_element
+            if (duration) wait = MIN(wait, elapsed < duration ? duration - elapsed : 0);
+        }
+    }
+    return wait;
+}
+#endif
+
+/**@brief   Produces channel output from the interpolated values, and hands it to the pulse timers.
+ *
+ * Layers are mixed in first, then any crossfade from the previous pattern, then output-stage pattern adjusts.
+ */
+static void plan_output(uint8_t channel, zappy_pattern_t const *p_pattern) {
+    pattern_plan_t *plan = channel_plan(channel);
+    #if PATTERN_LAYER_COUNT
+    for (uint8_t i = 0; i < PATTERN_LAYER_COUNT; i++) {
+        pattern_layer_t *layer = &pattern_layers[i][channel];
+        if (!layer->p_pattern) continue;
+        layer_evaluate(channel, layer, us_timestamp());
+        layer_mix(plan, layer);
+    }
+    #endif
+    if (plan->fade_duration) {
+        uint32_t faded = us_timestamp() - plan->fade_start;
+        if (faded >= plan->fade_duration) {
+            plan->fade_duration = 0;
+        } else {
+            plan_fade(plan, recip_scale(faded, plan->fade_recip.mul, plan->fade_recip.shift, 16));
+        }
+    }
+    zappy_pulse_t pulse;
+    memcpy(pulse, plan->pulse, sizeof(zappy_pulse_t));
+    if (p_pattern->pattern_adjust.algorithm == ADJUST_PULSE_PERIOD) {
+        uint16_t offset = ((pulse[max_pulse_index(channel)] - min_pulse_ticks(channel)) * plan->offset_scale) >> 16;
+        // Subtract pattern adjust value from all pulses ensuring the min pulse value will be > MIN_PULSE_VALUE.
+        for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+            if (pulse[i] != 0) {
+                pulse[i] -= offset;
+            }
+        }
+    }
+    #if PULSE_BURST_MIN_GAP_us
+    set_pulse_burst(channel, plan->burst_count, plan->burst_spacing);
+    #endif
+    set_pulse(channel, pulse, plan->power_modulator);
+}
+
+/// Advances a generator pattern by elapsed microseconds, and outputs it.
+static void plan_generate(uint8_t channel, zappy_pattern_t const *p_pattern, uint32_t elapsed) {
+    pattern_plan_t *plan = channel_plan(channel);
+    plan_mix(plan, generator_advance(&plan->gen, ((uint64_t) elapsed * plan->gen_speed) >> 16));
+    plan_output(channel, p_pattern);
+    pattern_progress[channel] = generator_progress(&plan->gen);
+}
+
+uint32_t update_pulses(void) {
+    #ifdef DEBUG
+    uint32_t cycles_start = DWT->CYCCNT;
+    #endif
+    uint32_t now = us_timestamp();
+    uint32_t next_update = PATTERN_NO_DEADLINE;
     for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
-        if (!(channels_active & (1UL << channel))) continue;    // Channel isn't active
+        #if STREAM_BUFFER_ELEMENTS
+        if (stream_active(channel)) {
+            if (channels_active & (1UL << channel)) next_update = MIN(next_update, stream_update(channel, now));
+            continue;
+        }
+        #endif
         pattern_playback_t pb = pattern_playback[channel];
         if (!pb.p_pattern) continue;    // No pattern selected
-        zappy_pattern_element_t const *p_element = &pb.p_pattern->elements[pb.element_index];
-        zappy_pattern_element_t const *p_next_element = &pb.p_pattern->elements[(pb.element_index + 1)
-                                                                                % pb.p_pattern->element_count];
-        uint32_t elapsed = ms_timestamp() - pb.element_start;
+        pattern_plan_t *plan = channel_plan(channel);
+        if (plan->track) continue;      // Multi-track patterns are decoded once, by the channel playing track 0
+        uint32_t tracks = plan_track_channels(channel);
+        if (!(channels_active & tracks)) continue;    // No channel of the pattern is active
         uint16_t adj = pattern_adjusts[channel];
-        uint16_t completion = 0;
-        switch (pb.p_pattern->pattern_adjust.algorithm) {
-            case ADJUST_PLAYBACK_SPEED: {
-                // TODO: Change parameter interpretation algorithm.
-                //      Pattern adjust should only increase playback speed, because intensity scales with speed.
-                //      Keep general curve shape, but have the adjust parameter control the max speed multiplier.
-                //      Allowing pattern adjust to slow patterns down isn't useful.
-
-                // Scale up pattern adjust parameter to uint16 range
-                uint16_t adj_offset = (pb.p_pattern->pattern_adjust.parameters << 4);
-                int32_t offset = adj - adj_offset;
-                uint32_t offset_squared = offset * offset;
-                uint32_t scaler;
-                if (adj_offset > HALF_PATTERN_ADJUST) {
-                    scaler = (4 * (uint32_t) adj_offset) / 7 - (offset_squared / 2) / adj_offset;
-                } else {
-                    scaler = (4 * (uint32_t) (MAX_PATTERN_ADJUST - adj_offset)) / 7 -
-                                  (offset_squared / 2) / (MAX_PATTERN_ADJUST - adj_offset);
-                }
-                uint32_t duration;
-                if (offset < 0) {
-                    // Slow pattern down. Want a positive duration, so subtract offset
-                    duration = (scaler - offset) * p_element->duration / scaler;
-                } else {
-                    // Speed pattern up.
-                    duration = scaler * p_element->duration / (scaler + offset);
-                }
-                if (!duration || elapsed >= duration) {
-                    iter_element(channel);
-                } else {
-                    completion = 0x10000 * elapsed / duration;
-                    interpolate_pulse(completion, p_element, p_next_element);
-                }
+        #if PATTERN_TIMER_SCHEDULING
+        if (adj == plan->adjust && (int32_t) (plan->deadline - now) > 0) {
+            // Output can't have changed yet
+            next_update = MIN(next_update, plan->deadline - now);
+            continue;
+        }
+        #endif
+        if (pattern_switch_timed(channel, now)) {
+            pattern_switch(channel, plan->started + pattern_queues[channel].length, now);
+            pb = pattern_playback[channel];
+            plan = channel_plan(channel);
+        }
+        if (plan->generator) {
+            if (adj != plan->adjust) plan_adjust(plan, pb.p_pattern, adj);
+            plan_generate(channel, pb.p_pattern, now - plan->gen_time);
+            plan->gen_time = now;
+            uint32_t wait = pattern_switch_wait(channel, now, plan->step_interval);
+            #if PATTERN_LAYER_COUNT
+            wait = layers_wait(channel, now, wait);
+            #endif
+            plan->deadline = now + wait;
+            next_update = MIN(next_update, wait);
+            continue;
+        }
+        uint32_t elapsed = now - pb.element_start;
+        uint32_t duration = plan_duration(plan, pb.element_index);
+        if (adj != plan->adjust) {
+            for (uint8_t track = channel; tracks >> track; track++) {
+                if (!(tracks & (1UL << track))) continue;
+                plan_adjust(channel_plan(track), pb.p_pattern, adj);
+                plan_step_interval(channel_plan(track), pb.element_index);
+                duration = plan_duration(plan, pb.element_index);
+                // Element duration changed, so re-derive interpolator deltas from the current position.
+                plan_interp(track, MIN(elapsed, duration));
             }
-                break;
-            case ADJUST_PULSE_PERIOD: {
-                if (!p_element->duration || elapsed >= p_element->duration) {
-                    iter_element(channel);
-                } else {
-                    completion = 0x10000 * elapsed / p_element->duration;
-                    interpolate_pulse(completion, p_element, p_next_element);
-                }
-                uint16_t offset =
-                    (pulse_cache[max_pulse_index(channel)] - MIN_PULSE_VALUE) * (uint32_t) adj /
-                    (MAX_PATTERN_ADJUST);
-                // Subtract pattern adjust value from all pulses ensuring the min pulse value will be > MIN_PULSE_VALUE.
-                for (uint8_t i = 0; i < PULSE_EDGES; i++) {
-                    if (pulse_cache[i] != 0) {
-                        pulse_cache[i] -= offset;
-                    }
-                }
+        }
+        if (!duration || elapsed >= duration) {
+            iter_element(channel, now);
+            pb = pattern_playback[channel];
+            plan = channel_plan(channel);
+            elapsed = now - pb.element_start;
+            duration = plan_duration(plan, pb.element_index);
+        }
+        uint16_t completion = 0;
+        uint32_t wait = 0;
+        if (elapsed < duration) {
+            completion = recip_scale(elapsed, plan->element_recip.mul, plan->element_recip.shift, 16);
+            wait = pattern_switch_wait(channel, now, duration - elapsed);
+        } else if (!duration) {
+            // A whole pass of elements without duration, so nothing changes until playback state does
+            wait = pattern_switch_wait(channel, now, PATTERN_NO_DEADLINE);
+        }
+        uint16_t progress = plan_progress(plan, pb.element_index, elapsed);
+        // Fan the decoded position out to every track
+        for (uint8_t track = channel; tracks >> track; track++) {
+            if (!(tracks & (1UL << track))) continue;
+            pattern_plan_t *track_plan = channel_plan(track);
+            if (track_plan->p_element->easing == EASING_LINEAR || track_plan->p_element->easing == EASING_NONE) {
+                plan_interp_advance(track, elapsed);
+            } else {
+                interp_ease(track_plan, completion);
             }
-                break;
-            default:
-            case ADJUST_IGNORED:
-                // Ignore pattern adjust, use unmodified pattern pulses.
-                if (elapsed > p_element->duration) {
-                    iter_element(channel);
-                } else {
-                    completion = 0x10000 * elapsed / p_element->duration;
-                    interpolate_pulse(completion, p_element, p_next_element);
-                }
-                break;
+            if (channels_active & (1UL << track)) plan_output(track, pb.p_pattern);
+            pattern_progress[track] = progress;
+            wait = MIN(wait, track_plan->step_interval);
+            #if PATTERN_LAYER_COUNT
+            wait = layers_wait(track, now, wait);
+            #endif
         }
-        set_pulse(channel, pulse_cache, *power_mod_cache);
-        pattern_progress[channel] = (0x10000 * pb.element_index + completion) / pb.p_pattern->element_count;
+        plan->deadline = now + wait;
+        next_update = MIN(next_update, wait);
     }
+    #ifdef DEBUG
+    update_pulses_cycles = DWT->CYCCNT - cycles_start;
+    update_pulses_cycles_max = MAX(update_pulses_cycles, update_pulses_cycles_max);
+    #endif
+    return next_update;
+}
+
+#ifdef DEBUG
+void patterns_cycles_log(void) {
+    NRF_LOG_INFO("update_pulses cycles: %u, max %u", update_pulses_cycles, update_pulses_cycles_max);
+}
+#endif
+
+void update_pulses_request(void) {
+    #if PATTERN_TIMER_SCHEDULING
+    uint32_t now = us_timestamp();
+    for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+        channel_plan(channel)->deadline = now;
+    }
+    pattern_timer_start(0);
+    #endif
+}
+
+#if PATTERN_INTERPOLATE_PER_PULSE
+/// Adjusts the current element duration for per-pulse playback. Only a few divisions, so safe within interrupts.
+static void plan_pulse_duration(pattern_plan_t *plan, zappy_pattern_t const *p_pattern, uint16_t element_index) {
+    zappy_pattern_element_t const *p_timing = plan_track_element(plan, p_pattern, element_index, 0);
+    plan->pulse_duration = adjusted_duration_us(p_pattern, plan->adjust, p_timing->duration);
+    plan->pulse_recip = reciprocal(plan->pulse_duration);
+}
+
+void pattern_pulse_period(uint8_t channel, uint32_t period) {
+    pattern_playback_t *pb = &pattern_playback[channel];
+    zappy_pattern_t const *p_pattern = pb->p_pattern;
+    if (!p_pattern) {
+        #if STREAM_BUFFER_ELEMENTS
+        if (stream_active(channel)) stream_update(channel, us_timestamp());
+        #endif
+        return;     // No pattern selected
+    }
+    if (pattern_queues[channel].p_pattern) {
+        uint32_t now = us_timestamp();
+        if (pattern_switch_timed(channel, now)) {
+            pattern_switch(channel, now, now);
+            p_pattern = pb->p_pattern;
+        }
+    }
+    pattern_plan_t *plan = channel_plan(channel);
+    // Every track of a multi-track pattern follows the adjust value of track 0
+    uint16_t adj = pattern_adjusts[channel - plan->track];
+    if (adj != plan->adjust) {
+        plan->adjust = adj;
+        plan->offset_scale = ((uint32_t) adj << 16) / MAX_PATTERN_ADJUST;
+        if (plan->generator) {
+            plan_generator_rate(plan, p_pattern);
+        } else {
+            plan_pulse_duration(plan, p_pattern, pb->element_index);
+        }
+    }
+    if (plan->generator) {
+        plan_generate(channel, p_pattern, period);
+        return;
+    }
+    plan->pulse_elapsed += period;
+    // Carry time past the end of an element into the next, so playback stays locked to the pulse train.
+    // Bounded by element count in case every element has zero duration.
+    for (uint16_t i = 0; plan->pulse_elapsed >= plan->pulse_duration && i < plan->count; i++) {
+        plan->pulse_elapsed -= plan->pulse_duration;
+        if (pattern_switch_pass(channel)) {
+            // Gapless, the carried time plays from the start of the queued pattern
+            uint32_t carry = plan->pulse_elapsed;
+            uint32_t now = us_timestamp();
+            pattern_switch(channel, now - carry, now);
+            p_pattern = pb->p_pattern;
+            plan = channel_plan(channel);
+            plan->pulse_elapsed = carry;
+            if (plan->generator) break;
+            continue;
+        }
+        pb->element_index = plan->next_index;
+        plan_element(plan, p_pattern, pb->element_index);
+        plan_pulse_duration(plan, p_pattern, pb->element_index);
+        pb->element_start = us_timestamp();
+    }
+    if (plan->generator) {
+        plan_generate(channel, p_pattern, plan->pulse_elapsed);
+        return;
+    }
+    uint16_t completion = 0;
+    if (plan->pulse_elapsed < plan->pulse_duration) {
+        completion = recip_scale(plan->pulse_elapsed, plan->pulse_recip.mul, plan->pulse_recip.shift, 16);
+    }
+    switch (plan->p_element->easing) {
+        case EASING_NONE:
+            plan_lerp(plan, 0);
+            break;
+        case EASING_LINEAR:
+            plan_lerp(plan, completion);
+            break;
+        default:
+            interp_ease(plan, completion);
+            break;
+    }
+    plan_output(channel, p_pattern);
+}
+#endif
+
+void refresh_pattern_progress(void) {
+    #if !PATTERN_INTERPOLATE_PER_PULSE
+    uint32_t now = us_timestamp();
+    #endif
+    for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+        pattern_playback_t pb = pattern_playback[channel];
+        if (!pb.p_pattern) continue;    // No pattern selected
+        pattern_plan_t *plan = channel_plan(channel);
+        if (plan->generator) {
+            pattern_progress[channel] = generator_progress(&plan->gen);
+            continue;
+        }
+        #if PATTERN_INTERPOLATE_PER_PULSE
+        // Pulse interrupts only track the current element, so duration tables are kept up to date here.
+        if (plan->ends_adjust != plan->adjust) plan_ends(plan, pb.p_pattern, plan->adjust);
+        uint32_t elapsed = plan->pulse_elapsed;
+        #else
+        uint32_t elapsed = now - pb.element_start;
+        #endif
+        pattern_progress[channel] = plan_progress(plan, pb.element_index, elapsed);
+    }
+}
+
+nrfx_err_t pattern_seek(uint8_t channel, uint16_t progress) {
+    pattern_playback_t *pb = &pattern_playback[channel];
+    zappy_pattern_t *p_pattern = pb->p_pattern;
+    if (!p_pattern) return NRFX_ERROR_INVALID_STATE;
+    pattern_plan_t *plan = channel_plan(channel);
+    if (plan->generator) {
+        // Hide the channel from pattern playback while its position changes
+        pb->p_pattern = NULL;
+        generator_seek(&plan->gen, progress);
+        pattern_progress[channel] = progress;
+        pb->p_pattern = p_pattern;
+        update_pulses_request();
+        return NRFX_SUCCESS;
+    }
+    // Tracks of a multi-track pattern share a timeline, so they all seek together
+    uint8_t first = channel - plan->track;
+    uint32_t tracks = plan_track_channels(first);
+    for (uint8_t track = first; tracks >> track; track++) {
+        // Hide the channels from pattern playback while their position changes
+        if (tracks & (1UL << track)) pattern_playback[track].p_pattern = NULL;
+    }
+    if (plan->ends_adjust != plan->adjust) plan_ends(plan, p_pattern, plan->adjust);
+    uint16_t count = plan->count;
+    uint64_t target = ((uint64_t) plan->ends[count - 1] * 1000 * progress) >> 16;
+    // Binary search for the first element ending after target
+    uint16_t low = 0, high = count - 1;
+    while (low < high) {
+        uint16_t mid = (low + high) / 2;
+        if ((uint64_t) plan->ends[mid] * 1000 > target) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    uint32_t offset = target - (uint64_t) plan_begin(plan, low) * 1000;
+    uint32_t start = us_timestamp() - offset;
+    for (uint8_t track = first; tracks >> track; track++) {
+        if (!(tracks & (1UL << track))) continue;
+        pattern_plan_t *track_plan = channel_plan(track);
+        if (track_plan->ends_adjust != track_plan->adjust) plan_ends(track_plan, p_pattern, track_plan->adjust);
+        pattern_playback[track].element_index = low;
+        // Loop counts can't be known mid-pattern, so they restart from the new position
+        vm_reset_loops(&track_plan->vm);
+        plan_element(track_plan, p_pattern, low);
+        plan_interp(track, offset);
+        #if PATTERN_INTERPOLATE_PER_PULSE
+        track_plan->pulse_elapsed = offset;
+        plan_pulse_duration(track_plan, p_pattern, low);
+        #endif
+        pattern_playback[track].element_start = start;
+        pattern_progress[track] = plan_progress(track_plan, low, offset);
+    }
+    for (uint8_t track = DEVICE_CHANNEL_COUNT; track-- > first;) {
+        // Update pointer last in single operation to avoid race conditions. Track 0 last, as it drives the others.
+        if (tracks & (1UL << track)) pattern_playback[track].p_pattern = p_pattern;
+    }
+    update_pulses_request();
+    return NRFX_SUCCESS;
+}
+
+/// Detaches a channel from any multi-track pattern. The other tracks stop if the channel was playing track 0.
+static void pattern_release_tracks(uint8_t channel) {
+    pattern_plan_t *plan = channel_plan(channel);
+    if (plan->tracks && !plan->track && pattern_playback[channel].p_pattern) {
+        uint32_t followers = plan_track_channels(channel) & ~(1UL << channel);
+        for (uint8_t follower = channel + 1; followers >> follower; follower++) {
+            if (!(followers & (1UL << follower))) continue;
+            pattern_playback[follower].p_pattern = NULL;
+            pattern_playback[follower].pattern_index = 0;
+            pattern_progress[follower] = 0;
+            channel_plan(follower)->tracks = 0;
+            channel_plan(follower)->track = 0;
+        }
+    }
+    plan->tracks = 0;
+    plan->track = 0;
+}
+
+/**@brief   Compiles a plan for a pattern, ready to play from the start.
+ *
+ * Doesn't touch channel playback state, so plans can be compiled ahead of time for queued patterns.
+ *
+ * @return  Element index playback starts at, or PATTERN_NO_ELEMENT if the pattern has nothing to play.
+ */
+static uint16_t plan_compile(pattern_plan_t *plan, zappy_pattern_t const *p_pattern, uint16_t adj,
+                             uint8_t tracks, uint8_t track) {
+    zappy_pattern_generator_t const *p_generator = pattern_generator(p_pattern);
+    plan->generator = p_generator != NULL;
+    plan->tracks = tracks;
+    plan->track = track;
+    plan->count = tracks ? pattern_frames(p_pattern, tracks) : p_pattern->element_count;
+    plan->fade_duration = 0;
+    // Generators mix between their low & high state elements, and run no control elements
+    uint16_t element_index = 1;
+    if (p_generator) {
+        vm_reset(&plan->vm);
+    } else {
+        element_index = pattern_first(plan, p_pattern);
+    }
+    if (element_index == PATTERN_NO_ELEMENT) return element_index;
+    plan_adjust(plan, p_pattern, adj);
+    plan_element(plan, p_pattern, element_index);
+    if (p_generator) {
+        generator_init(&plan->gen, p_generator);
+        plan->p_next_element = &p_generator->high;
+        plan_generator_rate(plan, p_pattern);
+    }
+    #if PATTERN_INTERPOLATE_PER_PULSE
+    plan->pulse_elapsed = 0;
+    plan_pulse_duration(plan, p_pattern, element_index);
+    #endif
+    return element_index;
 }
 
 nrfx_err_t pattern_play(uint8_t channel, uint16_t index) {
@@ -148,19 +1140,128 @@ nrfx_err_t pattern_play(uint8_t channel, uint16_t index) {
         zappy_pattern_t *p_pattern = NULL;
         nrfx_err_t err = get_nth_pattern(&p_pattern, index);
         if (err != NRFX_SUCCESS) return err;
-        // Set pattern adjust to 'neutral' when starting new pattern
-        pattern_adjusts[channel] = 0;
-        pattern_playback[channel].p_pattern = p_pattern;
-        pattern_playback[channel].pattern_index = index;
-        pattern_playback[channel].element_index = 0;
-        pattern_playback[channel].element_start = ms_timestamp();
+        uint16_t tracks = pattern_tracks(p_pattern);
+        if (tracks > DEVICE_CHANNEL_COUNT || (tracks && pattern_frames(p_pattern, tracks) == 0)) {
+            return NRFX_ERROR_INVALID_PARAM;
+        }
+        pulse_resolution_t resolution = pattern_resolution(p_pattern);
+        // Track n of a multi-track pattern plays on channel n, wherever it's started from
+        uint8_t first = tracks ? 0 : channel;
+        uint8_t last = tracks ? tracks - 1 : channel;
+        for (uint8_t track = first; track <= last; track++) {
+            #if STREAM_BUFFER_ELEMENTS
+            stream_stop(track);
+            #endif
+            pattern_release_tracks(track);
+            // Playing a pattern replaces anything queued
+            pattern_queues[track].p_pattern = NULL;
+            // Set pattern adjust to 'neutral' when starting new pattern
+            pattern_adjusts[track] = 0;
+            // Hide the channel from update_pulses while its plan is compiled
+            pattern_playback[track].p_pattern = NULL;
+            set_pulse_resolution(track, resolution);
+        }
+        for (uint8_t track = first; track <= last; track++) {
+            uint16_t element_index = plan_compile(channel_plan(track), p_pattern, 0, tracks, track - first);
+            if (element_index == PATTERN_NO_ELEMENT) {
+                // Control elements never reach anything to play
+                pattern_playback[track].pattern_index = 0;
+                pattern_progress[track] = 0;
+                return NRFX_ERROR_INVALID_PARAM;
+            }
+            pattern_playback[track].element_index = element_index;
+            plan_interp(track, 0);
+        }
+        // Tracks start together, so they stay in phase
+        uint32_t start = us_timestamp();
+        for (uint8_t track = last + 1; track-- > first;) {
+            channel_plan(track)->started = start;
+            channel_plan(track)->gen_time = start;
+            pattern_playback[track].pattern_index = index;
+            pattern_playback[track].element_start = start;
+            // Update pointer last in single operation to avoid race conditions. Track 0 last, as it drives the others.
+            pattern_playback[track].p_pattern = p_pattern;
+        }
         APP_ERROR_CHECK(app_sched_event_put(NULL, 0, SCHED_FN(update_adjusts)));
+        update_pulses_request();
     } else {
+        #if STREAM_BUFFER_ELEMENTS
+        stream_stop(channel);
+        #endif
+        pattern_release_tracks(channel);
+        pattern_queues[channel].p_pattern = NULL;
         pattern_playback[channel].p_pattern = NULL;
         pattern_playback[channel].pattern_index = 0;
+        pattern_progress[channel] = 0;
+    }
+    return NRFX_SUCCESS;
+}
+
+uint32_t pattern_channels(uint8_t channel, uint16_t index) {
+    zappy_pattern_t *p_pattern = NULL;
+    if (!index || get_nth_pattern(&p_pattern, index) != NRFX_SUCCESS) return 1UL << channel;
+    uint16_t tracks = pattern_tracks(p_pattern);
+    if (!tracks || tracks > DEVICE_CHANNEL_COUNT) return 1UL << channel;
+    return (1UL << tracks) - 1;
+}
+
+nrfx_err_t pattern_queue(uint8_t channel, uint16_t index, uint16_t passes, uint32_t length, uint32_t crossfade) {
+    pattern_queue_t *q = &pattern_queues[channel];
+    // Hide the queue from playback while the next plan is compiled
+    q->p_pattern = NULL;
+    if (!index) return NRFX_SUCCESS;
+    if (!pattern_playback[channel].p_pattern || channel_plan(channel)->tracks) return NRFX_ERROR_INVALID_STATE;
+    zappy_pattern_t *p_pattern = NULL;
+    nrfx_err_t err = get_nth_pattern(&p_pattern, index);
+    if (err != NRFX_SUCCESS) return err;
+    if (pattern_tracks(p_pattern)) return NRFX_ERROR_INVALID_PARAM;
+    // Switching happens mid-period, so the channel timer can't change resolution
+    if (pattern_resolution(p_pattern) != pulse_resolution(channel)) return NRFX_ERROR_INVALID_PARAM;
+    // Pattern adjust carries over, rather than resetting to neutral as when a pattern is played
+    uint16_t element_index = plan_compile(queued_plan(channel), p_pattern, pattern_adjusts[channel], 0, 0);
+    if (element_index == PATTERN_NO_ELEMENT) return NRFX_ERROR_INVALID_PARAM;
+    q->pattern_index = index;
+    q->element_index = element_index;
+    q->passes = passes;
+    q->length = length;
+    q->crossfade = crossfade;
+    // Update pointer last in single operation to avoid race conditions.
+    q->p_pattern = p_pattern;
+    update_pulses_request();
+    return NRFX_SUCCESS;
+}
+
+#if PATTERN_LAYER_COUNT
+nrfx_err_t pattern_layer_play(uint8_t channel, uint8_t layer_number, uint16_t index,
+                              layer_edge_mix_t edges, layer_power_mix_t power) {
+    if (!layer_number || layer_number > PATTERN_LAYER_COUNT) return NRFX_ERROR_INVALID_PARAM;
+    pattern_layer_t *layer = &pattern_layers[layer_number - 1][channel];
+    // Hide the layer from playback while its plan is compiled
+    layer->p_pattern = NULL;
+    layer->pattern_index = 0;
+    if (!index) return NRFX_SUCCESS;
+    zappy_pattern_t *p_pattern = NULL;
+    nrfx_err_t err = get_nth_pattern(&p_pattern, index);
+    if (err != NRFX_SUCCESS) return err;
+    if (pattern_tracks(p_pattern) || pattern_resolution(p_pattern) != pulse_resolution(channel)) {
+        return NRFX_ERROR_INVALID_PARAM;
     }
+    uint16_t element_index = plan_compile(&layer->plan, p_pattern, pattern_adjusts[channel], 0, 0);
+    if (element_index == PATTERN_NO_ELEMENT) return NRFX_ERROR_INVALID_PARAM;
+    uint32_t start = us_timestamp();
+    layer->plan.started = start;
+    layer->plan.gen_time = start;
+    layer->element_index = element_index;
+    layer->element_start = start;
+    layer->edges = edges;
+    layer->power = power;
+    layer->pattern_index = index;
+    // Update pointer last in single operation to avoid race conditions.
+    layer->p_pattern = p_pattern;
+    update_pulses_request();
     return NRFX_SUCCESS;
 }
+#endif
 
 static void queued_pattern_init(void) {
     for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
@@ -19,17 +19,109 @@ typedef struct {
     zappy_pattern_t *p_pattern;
     uint16_t pattern_index;
     uint16_t element_index;
-    uint32_t element_start;
+    uint32_t element_start;     // us_timestamp of the scheduled start of the current element
 } pattern_playback_t;
 
 extern zappy_pattern_adjusts_t pattern_adjusts;
 extern zappy_pattern_progress_t pattern_progress;
 extern pattern_playback_t pattern_playback[DEVICE_CHANNEL_COUNT];
 
-void update_pulses(void);
+/// Pattern engine runs from its own app_timer, rather than every update tick or every pulse period.
+#define PATTERN_TIMER_SCHEDULING (PATTERN_DEADLINE_SCHEDULING && !PATTERN_INTERPOLATE_PER_PULSE)
 
+/// Returned by update_pulses when no channel needs a future update.
+#define PATTERN_NO_DEADLINE UINT32_MAX
+
+// Pulses can't change faster than the shortest pulse period, so there's no point updating more often.
+#define PATTERN_MIN_UPDATE_INTERVAL_us (MIN_PULSE_VALUE)
+
+/**@brief   Function to update pulses of all active channels playing a pattern.
+ *
+ * @return  Microseconds until the earliest channel output change, or PATTERN_NO_DEADLINE.
+ */
+uint32_t update_pulses(void);
+
+#ifdef DEBUG
+/// Logs the most recent & slowest cycle counts of update_pulses, alongside pulse_cycles_log.
+void patterns_cycles_log(void);
+#endif
+
+/**@brief   Function to request pattern playback be re-evaluated on every channel as soon as possible.
+ *
+ * Needed with PATTERN_DEADLINE_SCHEDULING whenever playback state changes outside of update_pulses,
+ * e.g. channels enabled, patterns started, or pattern adjusts changed.
+ */
+void update_pulses_request(void);
+
+/**@brief   Function to advance a channel's pattern by one pulse period and update its pulse.
+ *
+ * Used with PATTERN_INTERPOLATE_PER_PULSE, called from update_pulse_edges at every pulse period boundary.
+ *
+ * @param[in] channel   Channel whose pulse period ended.
+ * @param[in] period    Length of the pulse period that ended, in microseconds.
+ */
+void pattern_pulse_period(uint8_t channel, uint32_t period);
+
+/// Recalculate pattern_progress from current time, without updating pulses.
+void refresh_pattern_progress(void);
+
+/// Plays a pattern from its start, setting the pulse resolution of each channel it plays on to the pattern's.
 nrfx_err_t pattern_play(uint8_t channel, uint16_t index);
 
+/// Channels pattern_play plays a pattern on when started from channel, every track's for a multi-track pattern.
+uint32_t pattern_channels(uint8_t channel, uint16_t index);
+
+/**@brief   Function to queue the pattern a channel switches to after its current one.
+ *
+ * The queued pattern's playback plan is compiled immediately, so switching needs no pattern decoding. Switching
+ * keeps the channel's pattern adjust value, and re-queueing replaces the previously queued pattern.
+ *
+ * @param[in] channel   Channel to queue pattern on.
+ * @param[in] index     Pattern index, 1-indexed. 0 cancels the queued pattern.
+ * @param[in] passes    Passes through the current pattern before switching at the end of a pass. 0 to switch by time.
+ * @param[in] length    Time from current pattern start to switch, in microseconds. Ignored unless passes is 0.
+ * @param[in] crossfade Time to fade from the current pattern's output to the queued pattern, in microseconds.
+ *                      0 switches gaplessly.
+ *
+ * @retval  NRFX_SUCCESS                Pattern queued.
+ * @retval  NRFX_ERROR_INVALID_ADDR     No pattern at index.
+ * @retval  NRFX_ERROR_INVALID_PARAM    Pattern is multi-track, has nothing to play, or its pulse resolution differs
+ *                                      from the channel's.
+ * @retval  NRFX_ERROR_INVALID_STATE    Channel isn't playing a pattern, or is playing a multi-track pattern.
+ */
+nrfx_err_t pattern_queue(uint8_t channel, uint16_t index, uint16_t passes, uint32_t length, uint32_t crossfade);
+
+#if PATTERN_LAYER_COUNT
+/**@brief   Function to play a pattern layered on top of a channel's main pattern.
+ *
+ * Layers loop independently of the main pattern, are mixed into its output in layer order, and only sound while
+ * the channel plays a main pattern. Playing a main pattern leaves layers running.
+ *
+ * @param[in] channel   Channel to play layer on.
+ * @param[in] layer     Layer number, 1 to PATTERN_LAYER_COUNT.
+ * @param[in] index     Pattern index, 1-indexed. 0 stops the layer.
+ * @param[in] edges     How layer pulse edges combine with the output beneath.
+ * @param[in] power     How layer power modulator combines with the output beneath.
+ *
+ * @retval  NRFX_SUCCESS                Layer playing, or stopped.
+ * @retval  NRFX_ERROR_INVALID_ADDR     No pattern at index.
+ * @retval  NRFX_ERROR_INVALID_PARAM    Invalid layer number, or pattern is multi-track, has nothing to play, or its
+ *                                      pulse resolution differs from the channel's.
+ */
+nrfx_err_t pattern_layer_play(uint8_t channel, uint8_t layer, uint16_t index,
+                              layer_edge_mix_t edges, layer_power_mix_t power);
+#endif
+
+/**@brief   Function to move pattern playback of a channel to a time position.
+ *
+ * @param[in] channel   Channel to seek.
+ * @param[in] progress  Time position as a fraction of 0x10000 of the adjusted pattern duration.
+ *
+ * @retval  NRFX_SUCCESS                Playback position updated.
+ * @retval  NRFX_ERROR_INVALID_STATE    No pattern playing on channel.
+ */
+nrfx_err_t pattern_seek(uint8_t channel, uint16_t progress);
+
 /** @note Ensure pattern_init is called after storage_init.
  */
 void patterns_init(void);
@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "playlist.h"
+#include "pattern_control.h"
+#include "storage.h"
+
+static zappy_playlist_t playlists[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = {0}};
+
+static inline uint8_t playlist_next_entry(zappy_playlist_t const *p_playlist) {
+    return p_playlist->entry + 1 == p_playlist->entry_count ? 0 : p_playlist->entry + 1;
+}
+
+/// Queues the entry after the current one, so pattern playback has it prepared before switching.
+static nrfx_err_t playlist_queue_next(uint8_t channel) {
+    zappy_playlist_t *p_playlist = &playlists[channel];
+    if (!p_playlist->repeat && p_playlist->entry + 1 == p_playlist->entry_count) {
+        // Last entry keeps playing
+        return pattern_queue(channel, 0, 0, 0, 0);
+    }
+    zappy_playlist_entry_t const *p_entry = &p_playlist->entries[p_playlist->entry];
+    zappy_playlist_entry_t const *p_next = &p_playlist->entries[playlist_next_entry(p_playlist)];
+    return pattern_queue(channel, p_next->index, p_entry->loops, p_entry->duration * 1000000UL,
+                         p_next->crossfade * 1000UL);
+}
+
+nrfx_err_t playlist_play(uint8_t channel, zappy_playlist_t const *p_playlist) {
+    if (!p_playlist->entry_count) {
+        playlist_stop(channel);
+        return NRFX_SUCCESS;
+    }
+    if (p_playlist->entry_count > PLAYLIST_MAX_ENTRIES) return NRFX_ERROR_INVALID_PARAM;
+    for (uint8_t i = 0; i < p_playlist->entry_count; i++) {
+        zappy_playlist_entry_t const *p_entry = &p_playlist->entries[i];
+        if (!p_entry->loops && (!p_entry->duration || p_entry->duration > PLAYLIST_MAX_DURATION_s)) {
+            return NRFX_ERROR_INVALID_PARAM;
+        }
+        zappy_pattern_t const *p_pattern = NULL;
+        nrfx_err_t err = get_nth_pattern(&p_pattern, p_entry->index);
+        if (err != NRFX_SUCCESS) return err;
+    }
+    playlist_stop(channel);
+    nrfx_err_t err = pattern_play(channel, p_playlist->entries[0].index);
+    if (err != NRFX_SUCCESS) return err;
+    zappy_playlist_t *p_dest = &playlists[channel];
+    memcpy(p_dest, p_playlist, sizeof(zappy_playlist_t));
+    p_dest->entry = 0;
+    err = playlist_queue_next(channel);
+    if (err != NRFX_SUCCESS) p_dest->entry_count = 0;
+    return err;
+}
+
+void playlist_stop(uint8_t channel) {
+    playlists[channel].entry_count = 0;
+    pattern_queue(channel, 0, 0, 0, 0);
+}
+
+zappy_playlist_t const *playlist_get(uint8_t channel) {
+    return &playlists[channel];
+}
+
+void playlist_pattern_switched(uint8_t *p_channel) {
+    uint8_t channel = *p_channel;
+    zappy_playlist_t *p_playlist = &playlists[channel];
+    if (!p_playlist->entry_count) return;
+    uint8_t next = playlist_next_entry(p_playlist);
+    // Ignore switches queued before the playlist last changed
+    if (pattern_playback[channel].pattern_index != p_playlist->entries[next].index) return;
+    p_playlist->entry = next;
+    if (playlist_queue_next(channel) != NRFX_SUCCESS) {
+        // Pattern deleted since the playlist started, so the current entry keeps playing
+        p_playlist->entry_count = 0;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <stdint.h>
+
+#include "serial_protocol.h"
+
+#include "nrfx.h"
+
+/**@brief   Function to play a playlist on a channel, from its first entry.
+ *
+ * @retval  NRFX_SUCCESS                Playlist playing, or cleared if it has no entries.
+ * @retval  NRFX_ERROR_INVALID_ADDR     An entry's pattern index is invalid.
+ * @retval  NRFX_ERROR_INVALID_PARAM    Too many entries, an entry without loops or duration, or a multi-track pattern.
+ */
+nrfx_err_t playlist_play(uint8_t channel, zappy_playlist_t const *p_playlist);
+
+/// Clears a channel's playlist, leaving its current pattern playing.
+void playlist_stop(uint8_t channel);
+
+/// Retrieves a channel's playlist. Entry count is zero if no playlist is playing.
+zappy_playlist_t const *playlist_get(uint8_t channel);
+
+/// Scheduled by pattern playback whenever a channel switches to its queued pattern.
+void playlist_pattern_switched(uint8_t *p_channel);
+
+#endif //PLAYLIST_H
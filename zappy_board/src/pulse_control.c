@@ -6,8 +6,12 @@
 
 #include "prv_utils.h"
 #include "pulse_control.h"
+#include "pattern_control.h"
 #include "pin_config.h"
 #include "display.h"
+#include "pulse_pwm.h"
+#include "timers.h"
+#include "triple_buffer.h"
 
 #include "hal/nrf_gpio.h"
 #include "hal/nrf_timer.h"
@@ -21,6 +25,13 @@
 #include "nrf_log.h"
 #endif
 
+#if PULSE_OUTPUT_PWM && PATTERN_INTERPOLATE_PER_PULSE
+#error "PATTERN_INTERPOLATE_PER_PULSE runs from the pulse timer interrupt, which PULSE_OUTPUT_PWM replaces."
+#endif
+#if PULSE_OUTPUT_PWM && PULSE_PHASE_INTERLEAVE
+#error "PULSE_PHASE_INTERLEAVE delays pulse timer periods, which PULSE_OUTPUT_PWM doesn't use."
+#endif
+
 uint8_t volatile channels_active = 0;
 
 #define INITIAL_PULSE { \
@@ -39,18 +50,43 @@ static uint32_t const gate_pins[DEVICE_CHANNEL_COUNT][2 /* Positive & negative e
     GATE_PIN_MAPPING(3),
 };
 
+#if !PULSE_OUTPUT_PWM
 static nrfx_timer_t const timers[DEVICE_CHANNEL_COUNT] = {
     NRFX_TIMER_INSTANCE(CHANNEL0_TIMER_INSTANCE),
     NRFX_TIMER_INSTANCE(CHANNEL1_TIMER_INSTANCE),
     NRFX_TIMER_INSTANCE(CHANNEL2_TIMER_INSTANCE),
     NRFX_TIMER_INSTANCE(CHANNEL3_TIMER_INSTANCE),
 };
+#endif
+
+// nrf_timer_frequency_t values are timer prescalers, so a tick is 2^value sixteenths of a microsecond.
+static nrf_timer_frequency_t const resolution_frequencies[PULSE_RESOLUTION_COUNT] = {
+    [PULSE_RESOLUTION_1_US] = NRF_TIMER_FREQ_1MHz,
+    [PULSE_RESOLUTION_62_5_NS] = NRF_TIMER_FREQ_16MHz,
+    [PULSE_RESOLUTION_16_US] = NRF_TIMER_FREQ_62500Hz,
+};
+
+static pulse_resolution_t volatile pulse_resolutions[DEVICE_CHANNEL_COUNT] = {
+    [0 ... _CHANNEL_ARR_MAX] = PULSE_RESOLUTION_1_US
+};
+
+#if !PULSE_OUTPUT_PWM
+// Resolution each channel's timer runs at, which catches up with pulse_resolutions at the end of a pulse period
+static pulse_resolution_t timer_resolutions[DEVICE_CHANNEL_COUNT] = {
+    [0 ... _CHANNEL_ARR_MAX] = PULSE_RESOLUTION_1_US
+};
+#endif
+
+static inline uint32_t us_pulse_ticks(uint8_t channel, uint32_t us) {
+    return (us << 4) >> resolution_frequencies[pulse_resolutions[channel]];
+}
 
 static nrfx_spim_t const spim = NRFX_SPIM_INSTANCE(DAC_SPIM_INSTANCE);
 
 #define DAC60504_DEVICE_ID_REG  1
 #define DAC60504_SPI_READ       0x80
 #define DAC60504_SPI_WRITE      0x00
+#define DAC60504_REG_SYNC       0x02
 #define DAC60504_REG_GAIN       0x04
 #define DAC60504_REG_DAC0       0x8
 #define DAC60504_REG_DAC1       0x9
@@ -74,24 +110,87 @@ typedef struct {
     uint32_t power_modulator;
     // Keep track of which pulse edge is last, enabling arbitrary pulse combinations
     uint8_t max_pulse_index;
-    uint16_t pv_selector;
+    #if PULSE_BURST_MIN_GAP_us
+    // Repeats of the pulse edges per period, each burst_spacing ticks earlier than the next. The last ends the period.
+    uint8_t burst_count;
+    uint16_t burst_spacing;
+    #endif
+    #if CHARGE_LIMITER
+    // Ticks the gates are on per pulse period
+    uint32_t charge_on;
+    #endif
 } pulse_state_t;
 
-// Value set by user input, copied to compare register in state handler
+// Latest value set by user input or patterns, copied to compare registers by update_pulse_edges
 pulse_state_t volatile *pulse_states[DEVICE_CHANNEL_COUNT];
 
-// Because memcpy can be interrupted, use two arrays and alternate between them
-static pulse_state_t volatile pulse_states_store[DEVICE_CHANNEL_COUNT][2] = {
+// Triple buffered per channel, set_pulse writes & update_pulse_edges reads
+static pulse_state_t volatile pulse_states_store[DEVICE_CHANNEL_COUNT][3] = {
     [0 ... _CHANNEL_ARR_MAX] = {
-        [0 ... 1] = {
+        [0 ... 2] = {
             .pulse = INITIAL_PULSE,
             .power_modulator = 0,
             .max_pulse_index = INITIAL_PULSE_MAX_INDEX,
-            .pv_selector = 0
+            #if PULSE_BURST_MIN_GAP_us
+            .burst_count = 1,
+            #endif
         }
     }
 };
+static triple_buffer_t pulse_state_slots[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = TRIPLE_BUFFER_INIT};
 
+/// Publishes set_pulse's write slot as the latest pulse.
+static inline void pulse_state_publish(uint8_t channel) {
+    pulse_states[channel] = &pulse_states_store[channel][triple_buffer_publish(&pulse_state_slots[channel])];
+}
+
+/// Takes the latest published pulse for update_pulse_edges, if there's one it hasn't seen.
+static inline pulse_state_t volatile *pulse_state_take(uint8_t channel) {
+    return &pulse_states_store[channel][triple_buffer_take(&pulse_state_slots[channel])];
+}
+
+#if CHARGE_LIMITER
+typedef struct {
+    uint64_t charge;        /**< Power level × gate-on time in sixteenths of a microsecond, summed. */
+    uint64_t square;        /**< Power level squared × gate-on time in sixteenths of a microsecond, summed. */
+} charge_tally_t;
+
+// Modulator each channel's pulse was set with, before the charge limiter's scale
+static uint16_t power_mods[DEVICE_CHANNEL_COUNT] = {0};
+// Level last written to each channel's DAC output, with modulator & charge scale applied
+static uint16_t volatile dac_levels[DEVICE_CHANNEL_COUNT] = {0};
+
+/// Ticks a pulse state's gates are on per period.
+static uint32_t charge_on_ticks(pulse_state_t volatile const *ps) {
+    uint32_t on = 0;
+    for (uint8_t gate = 0; gate < 2; gate++) {
+        // Edges toggle, so a gate is on between its two edges in either order
+        uint16_t a = ps->pulse[2 * gate];
+        uint16_t b = ps->pulse[2 * gate + 1];
+        if (a && b) on += a > b ? a - b : b - a;
+    }
+    #if PULSE_BURST_MIN_GAP_us
+    on *= ps->burst_count;
+    #endif
+    return on;
+}
+
+#if !PULSE_OUTPUT_PWM
+// Charge delivered by each channel's ended pulse periods, since charge_limit_update last took it
+static charge_tally_t charge_periods[DEVICE_CHANNEL_COUNT];
+
+/// Adds the charge of a channel's pulse period to its tally, as the period ends.
+static inline void charge_period_end(uint8_t channel, pulse_state_t volatile const *ps) {
+    // A level written during the period only latches at its end, so this is at most a period early
+    uint32_t level = dac_levels[channel];
+    uint64_t charge = (uint64_t) level * ps->charge_on << resolution_frequencies[timer_resolutions[channel]];
+    charge_periods[channel].charge += charge;
+    charge_periods[channel].square += charge * level;
+}
+#endif
+#endif
+
+#if !PULSE_OUTPUT_PWM
 // An Software Interrupt
 static nrfx_swi_t swi;
 
@@ -102,51 +201,489 @@ static nrf_ppi_channel_t volatile ppi_channels[DEVICE_CHANNEL_COUNT][PULSE_EDGES
     {[0 ... _CHANNEL_ARR_MAX] = {0xFF, 0xFF, 0xFF, 0xFF}};
 
 static nrf_ppi_channel_t volatile active_forks[DEVICE_CHANNEL_COUNT] = {0};
+#endif
 
 // Value set on user input, copied to pwm_tick_counts while channel is idle
 // Array exposed to easily copy values from
 zappy_power_levels_t volatile power_levels = {[0 ... _CHANNEL_ARR_MAX] = INITIAL_CHANNEL_POWER};
 
+static void dac_period_end(uint8_t channel);
+
+#if !PULSE_OUTPUT_PWM
 #ifdef DEBUG
 static uint32_t volatile no_flags_count = 0;
+// Entry to exit of update_pulse_edges, which must finish well within the shortest gap before a pulse edge.
+static uint32_t volatile update_edges_cycles = 0;
+static uint32_t volatile update_edges_cycles_max = 0;
 #endif
 
-static void update_pulse_edges(uint8_t __unused _swi, uint16_t flags) {
-    if (!flags) {
-        #ifdef DEBUG
-        no_flags_count++;
+// Passed as the SWI instance when update_pulse_edges is called directly, outside of the interrupt
+#define UPDATE_EDGES_DIRECT_CALL 0xFF
+
+// Compare values, clearing edge & shorts last written to each channel's timer, so unchanged registers aren't rewritten.
+static uint32_t programmed_edges[DEVICE_CHANNEL_COUNT][PULSE_EDGES] = {0};
+static uint8_t programmed_max_index[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = PULSE_EDGES};
+static uint32_t programmed_shorts[DEVICE_CHANNEL_COUNT] = {0};
+
+#if PULSE_BURST_MIN_GAP_us
+// Burst sub-pulses still to play after the one playing. The max edge interrupts at the end of every sub-pulse, and
+// only the last one clears the timer, so while any remain update_channel_edges moves the edges on instead.
+static uint8_t burst_remaining[DEVICE_CHANNEL_COUNT] = {0};
+#endif
+
+#if PULSE_PHASE_INTERLEAVE
+/* Pulse periods of running channels are tracked on a common time line, in sixteenths of a microsecond, so gate-on
+ * windows of channels with equal periods can be spread apart by delaying a period. A timer only joins the time line by
+ * starting exactly as a running timer's max edge fires, through a PPI channel whose fork disables its own group, so
+ * each armed start fires once.
+ */
+// Start of each channel's current pulse period on the time line
+static uint32_t period_starts[DEVICE_CHANNEL_COUNT] = {0};
+// Ticks each channel's current pulse period is delayed by
+static uint32_t phase_slips[DEVICE_CHANNEL_COUNT] = {0};
+// Channels whose phase is solved again at their next period, having joined the time line or changed pulse
+static uint8_t volatile phase_unsolved = 0;
+// Pulse edges & burst each channel's phase was last solved for
+static zappy_pulse_t phase_pulses[DEVICE_CHANNEL_COUNT] = {0};
+#if PULSE_BURST_MIN_GAP_us
+static uint32_t phase_bursts[DEVICE_CHANNEL_COUNT] = {0};
+#endif
+// Channels whose timers run on the time line
+static uint8_t volatile phase_synced = 0;
+// Channels whose timers wait to start, one at a time, on the time line
+static uint8_t volatile phase_sync_waiting = 0;
+#define PHASE_NO_SYNC DEVICE_CHANNEL_COUNT
+// Channel whose timer start is armed, and the running channel whose max edge starts it
+static uint8_t volatile phase_sync_channel = PHASE_NO_SYNC;
+static uint8_t volatile phase_sync_reference = PHASE_NO_SYNC;
+static nrf_ppi_channel_t phase_sync_ppi;
+static nrf_ppi_channel_group_t phase_sync_group;
+#endif
+
+/**@brief   Stops a channel's timer wherever it is in its period, with both gates back to idle low.
+ *
+ * Gates toggle on compare events, so a timer stopped between a gate's toggles would leave it high, & restarted, every
+ * toggle after would be inverted.
+ */
+static void timer_stop_idle(uint8_t channel) {
+    nrfx_timer_disable(&timers[channel]);
+    nrfx_gpiote_out_task_force(gate_pins[channel][0], 0);
+    nrfx_gpiote_out_task_force(gate_pins[channel][1], 0);
+}
+
+/// Writes a channel's timer compare registers, with edges backed off by ticks to place earlier burst sub-pulses.
+static inline void program_edges(uint8_t channel, pulse_state_t volatile const *ps, uint32_t backoff) {
+    NRF_TIMER_Type *p_timer = timers[channel].p_reg;
+    #if PULSE_PHASE_INTERLEAVE
+    // Delaying every edge delays the whole period
+    uint32_t delay = phase_slips[channel];
+    #else
+    uint32_t delay = 0;
+    #endif
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        // Disabled edges stay disabled
+        uint32_t edge = ps->pulse[i] ? ps->pulse[i] - backoff + delay : 0;
+        if (edge != programmed_edges[channel][i]) {
+            p_timer->CC[i] = edge;
+            programmed_edges[channel][i] = edge;
+        }
+    }
+}
+
+static inline void program_shorts(uint8_t channel, uint32_t shorts) {
+    if (shorts != programmed_shorts[channel]) {
+        timers[channel].p_reg->SHORTS = shorts;
+        programmed_shorts[channel] = shorts;
+    }
+}
+
+#if PULSE_BURST_MIN_GAP_us
+/// Moves a channel's timer edges on to the next burst sub-pulse, as the previous one ends.
+static void burst_step(uint8_t channel) {
+    pulse_state_t volatile *ps = &pulse_states_store[channel][pulse_state_slots[channel].read];
+    uint8_t remaining = --burst_remaining[channel];
+    program_edges(channel, ps, remaining * ps->burst_spacing);
+    // Last sub-pulse ends the period
+    if (!remaining) program_shorts(channel, TIMER_SHORTS_COMPARE0_CLEAR_Enabled << ps->max_pulse_index);
+}
+#endif
+
+#if PULSE_PHASE_INTERLEAVE
+static inline uint32_t ticks_sixteenths(uint8_t channel, uint32_t ticks) {
+    return ticks << resolution_frequencies[timer_resolutions[channel]];
+}
+
+/// Points the armed timer start at the reference channel's max edge, which moves with its pulse.
+static void phase_sync_assign(void) {
+    uint8_t reference = phase_sync_reference;
+    APP_ERROR_CHECK(nrfx_ppi_channel_assign(
+        phase_sync_ppi,
+        nrfx_timer_compare_event_address_get(&timers[reference], programmed_max_index[reference]),
+        nrfx_timer_task_address_get(&timers[phase_sync_channel], NRF_TIMER_TASK_START)));
+}
+
+/// Arms the next waiting timer to start at a running channel's max edge, or starts it if none are running.
+static void phase_sync_arm(void) {
+    CRITICAL_REGION_ENTER();
+    while (phase_sync_channel == PHASE_NO_SYNC && phase_sync_waiting) {
+        uint8_t channel = __builtin_ctz(phase_sync_waiting);
+        phase_sync_waiting &= ~(1UL << channel);
+        // Channels disabled while waiting don't start
+        if (!(channels_active & (1UL << channel))) continue;
+        uint8_t references = phase_synced & channels_active & ~(1UL << channel);
+        if (references) {
+            phase_sync_channel = channel;
+            phase_sync_reference = __builtin_ctz(references);
+            phase_sync_assign();
+            APP_ERROR_CHECK(nrfx_ppi_group_enable(phase_sync_group));
+        } else {
+            // Nothing running to keep step with, so the time line starts over from this channel
+            period_starts[channel] = 0;
+            phase_synced = 1UL << channel;
+            phase_unsolved |= 1UL << channel;
+            nrfx_timer_enable(&timers[channel]);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/// Places the timer an armed start started on the time line, once its reference channel's max edge has fired.
+static void phase_sync_service(uint8_t channel) {
+    if (phase_sync_reference != channel) return;
+    CRITICAL_REGION_ENTER();
+    // Group is disabled by the start firing. Still enabled, it was armed after this edge, so it waits for the next.
+    if (phase_sync_reference == channel && nrf_ppi_channel_enable_get(phase_sync_ppi) != NRF_PPI_CHANNEL_ENABLED) {
+        // Compare registers still hold the edge that fired
+        uint8_t started = phase_sync_channel;
+        period_starts[started] = period_starts[channel] +
+                                 ticks_sixteenths(channel, programmed_edges[channel][programmed_max_index[channel]]);
+        phase_synced |= 1UL << started;
+        phase_unsolved |= 1UL << started;
+        phase_sync_channel = PHASE_NO_SYNC;
+        phase_sync_reference = PHASE_NO_SYNC;
+        phase_sync_arm();
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/// Takes a channel's stopped timer off the time line, re-arming any start it was part of.
+static void phase_sync_stopped(uint8_t channel) {
+    CRITICAL_REGION_ENTER();
+    phase_synced &= ~(1UL << channel);
+    phase_sync_waiting &= ~(1UL << channel);
+    if (channel == phase_sync_reference) {
+        phase_sync_service(channel);
+        if (phase_sync_reference == channel) {
+            // Reference stopped before its edge fired, so the start waits on another channel
+            APP_ERROR_CHECK(nrfx_ppi_group_disable(phase_sync_group));
+            phase_sync_waiting |= 1UL << phase_sync_channel;
+            phase_sync_channel = PHASE_NO_SYNC;
+            phase_sync_reference = PHASE_NO_SYNC;
+        }
+    } else if (channel == phase_sync_channel) {
+        APP_ERROR_CHECK(nrfx_ppi_group_disable(phase_sync_group));
+        // Start may have fired before the group was disabled
+        timer_stop_idle(channel);
+        phase_sync_channel = PHASE_NO_SYNC;
+        phase_sync_reference = PHASE_NO_SYNC;
+    }
+    phase_sync_arm();
+    CRITICAL_REGION_EXIT();
+}
+
+/// Starts a channel's timer on the time line, unless it's already running on it or waiting to.
+static void timer_start(uint8_t channel) {
+    CRITICAL_REGION_ENTER();
+    if (!((phase_synced | phase_sync_waiting) & (1UL << channel)) && phase_sync_channel != channel) {
+        phase_sync_waiting |= 1UL << channel;
+        phase_sync_arm();
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/// Marks a channel's phase to be solved again if a newly taken pulse changes its period or gate-on windows.
+static void phase_pulse_taken(uint8_t channel, pulse_state_t volatile const *ps) {
+    bool changed = false;
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        if (ps->pulse[i] != phase_pulses[channel][i]) {
+            phase_pulses[channel][i] = ps->pulse[i];
+            changed = true;
+        }
+    }
+    #if PULSE_BURST_MIN_GAP_us
+    uint32_t burst = (uint32_t) ps->burst_count << 16 | ps->burst_spacing;
+    if (burst != phase_bursts[channel]) {
+        phase_bursts[channel] = burst;
+        changed = true;
+    }
+    #endif
+    if (changed) __atomic_fetch_or(&phase_unsolved, 1UL << channel, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+} phase_window_t;
+
+/// Gate-on windows of a pulse, from its period start, in sixteenths of a microsecond. Returns the number found.
+static uint8_t phase_windows(uint8_t channel, pulse_state_t volatile const *ps, phase_window_t windows[2]) {
+    uint8_t count = 0;
+    for (uint8_t gate = 0; gate < 2; gate++) {
+        uint16_t on = ps->pulse[2 * gate];
+        uint16_t off = ps->pulse[2 * gate + 1];
+        // Gates with a disabled edge toggle once a period, so have no fixed window
+        if (!on || !off) continue;
+        uint32_t start = MIN(on, off);
+        #if PULSE_BURST_MIN_GAP_us
+        // Whole burst counts as one window
+        start -= (ps->burst_count - 1) * ps->burst_spacing;
         #endif
-        return;
+        windows[count].start = ticks_sixteenths(channel, start);
+        windows[count].length = ticks_sixteenths(channel, MAX(on, off) - start);
+        count++;
     }
-    // https://stackoverflow.com/a/18050458/161366
-    uint8_t channel = 31 - __builtin_clz(flags);
+    return count;
+}
 
-    if (channels_active & (1UL << channel)) {
-        // Update timer compare registers for this channel
-        for (uint8_t i = 0; i < PULSE_EDGES; i++) {
-            if (i == (*pulse_states[channel]).max_pulse_index) {
-                if (active_forks[channel] != ppi_channels[channel][i]) {
-                    // Old PPI fork in place, clear it
-                    APP_ERROR_CHECK(nrfx_ppi_channel_fork_assign(active_forks[channel], 0));
-                    // Assign new fork
-                    active_forks[channel] = ppi_channels[channel][i];
-                    APP_ERROR_CHECK(nrfx_ppi_channel_fork_assign(active_forks[channel], egu_task_addrs[channel]));
-                }
-                nrfx_timer_extended_compare(
-                    &timers[channel],
-                    i,
-                    (*pulse_states[channel]).pulse[i],
-                    // Reset timer counter upon reaching this (max) compare value
-                    TIMER_SHORTS_COMPARE0_CLEAR_Enabled << i,
-                    false
-                );
-            } else {
-                nrfx_timer_extended_compare(&timers[channel], i, (*pulse_states[channel]).pulse[i], 0, false);
+/// Overlap of two windows repeating every period, with starts within the period.
+static uint32_t phase_overlap(phase_window_t a, phase_window_t b, uint32_t period) {
+    uint32_t overlap = 0;
+    for (int32_t shift = -(int32_t) period; shift <= (int32_t) period; shift += (int32_t) period) {
+        int32_t start = MAX((int32_t) a.start, (int32_t) b.start + shift);
+        int32_t end = MIN((int32_t) (a.start + a.length), (int32_t) (b.start + b.length) + shift);
+        if (end > start) overlap += end - start;
+    }
+    return overlap;
+}
+
+/// Overlap of a channel's windows delayed by slip with the others' windows.
+static uint32_t phase_overlap_total(phase_window_t const windows[], uint8_t count, phase_window_t const others[],
+                                    uint8_t others_count, uint32_t slip, uint32_t period) {
+    uint32_t overlap = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        phase_window_t window = {.start = (windows[i].start + slip) % period, .length = windows[i].length};
+        for (uint8_t j = 0; j < others_count; j++) overlap += phase_overlap(window, others[j], period);
+    }
+    return overlap;
+}
+
+/**@brief   Picks how many ticks to delay a channel's new pulse period, so its gate-on windows overlap others' least.
+ *
+ * Only running channels with the same period are compared, as windows of channels with other periods drift past each
+ * other whatever their phase. Candidate delays start one of the channel's windows as another channel's window ends.
+ * The phase is kept unless a delay strictly reduces overlap, so interleaved channels settle rather than chase.
+ * Only solved for channels in phase_unsolved, as a delay moves every later period too.
+ */
+static uint32_t phase_slip(uint8_t channel, pulse_state_t volatile const *ps) {
+    uint8_t others = phase_synced & channels_active & ~(1UL << channel);
+    if (!(phase_synced & (1UL << channel)) || !others) return 0;
+    phase_window_t windows[2];
+    uint8_t count = phase_windows(channel, ps, windows);
+    if (!count) return 0;
+    uint32_t period = ticks_sixteenths(channel, ps->pulse[ps->max_pulse_index]);
+    // Other channels' windows, from this period's start
+    phase_window_t placed[2 * (DEVICE_CHANNEL_COUNT - 1)];
+    uint8_t placed_count = 0;
+    do {
+        uint8_t other = __builtin_ctz(others);
+        others &= others - 1;
+        pulse_state_t volatile const *other_ps = &pulse_states_store[other][pulse_state_slots[other].read];
+        if (ticks_sixteenths(other, other_ps->pulse[other_ps->max_pulse_index]) != period) continue;
+        // Its pulse starts after any delay to its current period
+        int32_t offset = (int32_t) (period_starts[other] + ticks_sixteenths(other, phase_slips[other]) -
+                                    period_starts[channel]) % (int32_t) period;
+        if (offset < 0) offset += (int32_t) period;
+        phase_window_t other_windows[2];
+        uint8_t other_count = phase_windows(other, other_ps, other_windows);
+        for (uint8_t i = 0; i < other_count; i++) {
+            placed[placed_count].start = (other_windows[i].start + offset) % period;
+            placed[placed_count].length = other_windows[i].length;
+            placed_count++;
+        }
+    } while (others);
+    if (!placed_count) return 0;
+    uint32_t best_overlap = phase_overlap_total(windows, count, placed, placed_count, 0, period);
+    uint32_t best_slip = 0;
+    uint8_t tick_shift = resolution_frequencies[timer_resolutions[channel]];
+    for (uint8_t i = 0; i < count && best_overlap; i++) {
+        for (uint8_t j = 0; j < placed_count && best_overlap; j++) {
+            uint32_t slip = (placed[j].start + placed[j].length + period - windows[i].start) % period;
+            // Whole ticks, rounded up so windows don't touch
+            uint32_t slip_ticks = (slip + (1UL << tick_shift) - 1) >> tick_shift;
+            uint32_t overlap = phase_overlap_total(windows, count, placed, placed_count, slip_ticks << tick_shift,
+                                                   period);
+            if (overlap < best_overlap) {
+                best_overlap = overlap;
+                best_slip = slip_ticks;
             }
         }
-    } else {
+    }
+    return best_slip;
+}
+#endif
+
+#if PATTERN_INTERPOLATE_PER_PULSE
+// Sixteenths of a microsecond of 62.5 ns pulse periods not yet passed to pattern playback, so it doesn't drift.
+static uint8_t period_remainders[DEVICE_CHANNEL_COUNT] = {0};
+
+static uint32_t pulse_period_us(uint8_t channel, uint32_t ticks) {
+    // Period ran at the timer's resolution, which may be about to change
+    if (timer_resolutions[channel] != PULSE_RESOLUTION_62_5_NS) {
+        return (ticks << resolution_frequencies[timer_resolutions[channel]]) >> 4;
+    }
+    uint32_t sixteenths = ticks + period_remainders[channel];
+    period_remainders[channel] = sixteenths & 0xF;
+    return sixteenths >> 4;
+}
+#endif
+
+/// Whether a channel's timer is running, or may have been started by an armed start.
+static inline bool timer_running(uint8_t channel) {
+    #if PULSE_PHASE_INTERLEAVE
+    // Timers started through PPI don't show as enabled to the driver
+    return (phase_synced & (1UL << channel)) || phase_sync_channel == channel;
+    #else
+    return nrfx_timer_is_enabled(&timers[channel]);
+    #endif
+}
+
+/**@brief   Switches a channel's timer to the resolution its pulse values are set in.
+ *
+ * Called as the max edge clears the timer, with both gates off & the first edge of the new period yet to come, or
+ * with the timer stopped. The prescaler only takes effect from a stopped timer, so a running one stops & starts over.
+ */
+static void timer_resolution_apply(uint8_t channel, bool restart) {
+    timer_stop_idle(channel);
+    #if PULSE_PHASE_INTERLEAVE
+    phase_sync_stopped(channel);
+    #endif
+    nrfx_timer_clear(&timers[channel]);
+    pulse_resolution_t resolution = pulse_resolutions[channel];
+    nrf_timer_frequency_set(timers[channel].p_reg, resolution_frequencies[resolution]);
+    timer_resolutions[channel] = resolution;
+    #if PATTERN_INTERPOLATE_PER_PULSE
+    period_remainders[channel] = 0;
+    #endif
+    if (!restart) return;
+    #if PULSE_PHASE_INTERLEAVE
+    timer_start(channel);
+    #else
+    nrfx_timer_enable(&timers[channel]);
+    #endif
+}
+
+/// Programs a channel's timer with its latest pulse, for the pulse period that just started.
+static void update_channel_edges(uint8_t swi_instance, uint8_t channel) {
+    #if PULSE_PHASE_INTERLEAVE
+    if (swi_instance != UPDATE_EDGES_DIRECT_CALL) phase_sync_service(channel);
+    #endif
+    if (!(channels_active & (1UL << channel))) {
         nrfx_timer_disable(&timers[channel]);
+        #if PULSE_BURST_MIN_GAP_us
+        burst_remaining[channel] = 0;
+        #endif
+        #if PULSE_PHASE_INTERLEAVE
+        phase_sync_stopped(channel);
+        #endif
+        return;
+    }
+    #if PULSE_BURST_MIN_GAP_us
+    if (burst_remaining[channel] && swi_instance != UPDATE_EDGES_DIRECT_CALL) {
+        burst_step(channel);
+        return;
+    }
+    #endif
+    #if PATTERN_INTERPOLATE_PER_PULSE
+    // Interrupt fires as the max edge resets the timer, ending a pulse period of that length, with any phase slip, as
+    // the compare registers still hold it. Direct calls are made before the timer starts, so no period has elapsed.
+    uint32_t period_us = 0;
+    if (swi_instance != UPDATE_EDGES_DIRECT_CALL) {
+        period_us = pulse_period_us(channel, programmed_edges[channel][programmed_max_index[channel]]);
+    }
+    pattern_pulse_period(channel, period_us);
+    #endif
+    #if CHARGE_LIMITER
+    if (swi_instance != UPDATE_EDGES_DIRECT_CALL) {
+        charge_period_end(channel, &pulse_states_store[channel][pulse_state_slots[channel].read]);
+    }
+    #endif
+    #if PULSE_PHASE_INTERLEAVE
+    if (swi_instance != UPDATE_EDGES_DIRECT_CALL) {
+        // Period that just ended, with any delay, as the compare registers still hold it
+        period_starts[channel] += ticks_sixteenths(channel, programmed_edges[channel][programmed_max_index[channel]]);
+    }
+    #endif
+    if (timer_resolutions[channel] != pulse_resolutions[channel]) {
+        if (swi_instance != UPDATE_EDGES_DIRECT_CALL) {
+            timer_resolution_apply(channel, true);
+        } else if (!timer_running(channel)) {
+            // Direct calls precede starting the timer. One still running out a period switches at its max edge.
+            timer_resolution_apply(channel, false);
+        }
+    }
+    #if PULSE_PHASE_INTERLEAVE
+    uint8_t read = pulse_state_slots[channel].read;
+    #endif
+    pulse_state_t volatile *ps = pulse_state_take(channel);
+    #if PULSE_PHASE_INTERLEAVE
+    if (pulse_state_slots[channel].read != read) phase_pulse_taken(channel, ps);
+    phase_slips[channel] = 0;
+    if (swi_instance != UPDATE_EDGES_DIRECT_CALL && (phase_unsolved & (1UL << channel))) {
+        __atomic_fetch_and(&phase_unsolved, ~(1UL << channel), __ATOMIC_RELAXED);
+        phase_slips[channel] = phase_slip(channel, ps);
+    }
+    #endif
+    uint8_t max_pulse_index = ps->max_pulse_index;
+    if (max_pulse_index != programmed_max_index[channel]) {
+        if (active_forks[channel] != ppi_channels[channel][max_pulse_index]) {
+            // Old PPI fork in place, clear it
+            APP_ERROR_CHECK(nrfx_ppi_channel_fork_assign(active_forks[channel], 0));
+            // Assign new fork
+            active_forks[channel] = ppi_channels[channel][max_pulse_index];
+            APP_ERROR_CHECK(nrfx_ppi_channel_fork_assign(active_forks[channel], egu_task_addrs[channel]));
+        }
+        programmed_max_index[channel] = max_pulse_index;
+    }
+    // Reset timer counter upon reaching the max compare value
+    uint32_t shorts = TIMER_SHORTS_COMPARE0_CLEAR_Enabled << max_pulse_index;
+    uint32_t backoff = 0;
+    #if PULSE_BURST_MIN_GAP_us
+    burst_remaining[channel] = ps->burst_count - 1;
+    if (burst_remaining[channel]) {
+        // Timer runs on through every sub-pulse of the burst, starting from the first
+        shorts = 0;
+        backoff = burst_remaining[channel] * ps->burst_spacing;
     }
+    #endif
+    program_shorts(channel, shorts);
+    program_edges(channel, ps, backoff);
+    #if PULSE_PHASE_INTERLEAVE
+    // A start armed after this period's max edge fired waits on the next one
+    if (phase_sync_reference == channel) phase_sync_assign();
+    #endif
+    if (swi_instance != UPDATE_EDGES_DIRECT_CALL) dac_period_end(channel);
+}
+
+static void update_pulse_edges(uint8_t swi_instance, uint16_t flags) {
+    if (!flags) {
+        #ifdef DEBUG
+        no_flags_count++;
+        #endif
+        return;
+    }
+    #ifdef DEBUG
+    uint32_t cycles_start = DWT->CYCCNT;
+    #endif
+    // Every channel whose period ended since the last interrupt is pending, so service them all in one pass.
+    do {
+        uint8_t channel = __builtin_ctz(flags);
+        flags &= flags - 1;
+        update_channel_edges(swi_instance, channel);
+    } while (flags);
+    #ifdef DEBUG
+    update_edges_cycles = DWT->CYCCNT - cycles_start;
+    update_edges_cycles_max = MAX(update_edges_cycles, update_edges_cycles_max);
+    #endif
 }
 
 // For nrfx_timer_init. Must not be NULL.
@@ -154,10 +691,11 @@ static void pulse_timer_irq_evt_handler(nrf_timer_event_t __unused event_type, v
 
 static void timer_init(void) {
     nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG;
-    // Pulses are defined in milliseconds, so use a timer resolution to match.
-    timer_config.frequency = NRF_TIMER_FREQ_1MHz;
+    // Pulses default to microsecond ticks, set_pulse_resolution changes the prescaler per channel.
+    timer_config.frequency = resolution_frequencies[PULSE_RESOLUTION_1_US];
     timer_config.mode = NRF_TIMER_MODE_TIMER;
-    timer_config.bit_width = NRF_TIMER_BIT_WIDTH_16;
+    // Pulse values are 16 bits, so a period delayed by its phase slip can run its edges past them
+    timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
     for (int i = 0; i < DEVICE_CHANNEL_COUNT; i++) {
         APP_ERROR_CHECK(nrfx_timer_init(&timers[i], &timer_config, pulse_timer_irq_evt_handler));
     }
@@ -213,12 +751,59 @@ APP_ERROR_CHECK(nrfx_ppi_channel_enable(ppi_channel))
         // Enable gate
         nrfx_gpiote_out_task_enable(pin);
     }
+
+    #if PULSE_PHASE_INTERLEAVE
+    // Timer starts that keep channels in step. Firing disables the group, so each armed start fires once.
+    APP_ERROR_CHECK(nrfx_ppi_channel_alloc(&phase_sync_ppi));
+    APP_ERROR_CHECK(nrfx_ppi_group_alloc(&phase_sync_group));
+    APP_ERROR_CHECK(nrfx_ppi_channel_include_in_group(phase_sync_ppi, phase_sync_group));
+    APP_ERROR_CHECK(nrfx_ppi_channel_fork_assign(phase_sync_ppi,
+                                                 nrfx_ppi_task_addr_group_disable_get(phase_sync_group)));
+    #endif
 }
+#else
+/// Hands a channel's latest pulse to its PWM sequences, which play it from the next sequence boundary.
+static void pwm_update(uint8_t channel) {
+    pulse_state_t *ps = (pulse_state_t *) pulse_states[channel];
+    #if PULSE_BURST_MIN_GAP_us
+    pulse_pwm_set(channel, ps->pulse, ps->burst_count, ps->burst_spacing);
+    #else
+    pulse_pwm_set(channel, ps->pulse, 1, 0);
+    #endif
+}
+#endif
 
 static bool volatile spim_busy = false;
-// Unused callback needed to ensure async SPI calls
+// Channels whose DAC output needs writing. Taken in batches, each written in one chain of transfers, then latched
+// together by LDAC.
+static uint8_t volatile dac_dirty = 0;
+static bool volatile dac_queue_running = false;
+// Channels of the batch in progress, and those of it still to write
+static uint8_t volatile dac_batch = 0;
+static uint8_t volatile dac_batch_unwritten = 0;
+// Pulsing channel the next batch is taken from first, moved on past each one latched so they take turns
+static uint8_t volatile dac_batch_start = 0;
+
+// Written DAC values wait in the DAC's buffer registers until LDAC latches them at the end of a pulse period, in the
+// gap before the next pulse. LDAC latches every output, so a batch holds at most one pulsing channel, and latches at
+// its period end. Channels that aren't pulsing can't glitch, so they join any batch.
+#define DAC_NO_LATCH DEVICE_CHANNEL_COUNT
+static uint8_t volatile dac_latch_channel = DAC_NO_LATCH;
+// PPI drives LDAC low from the channel timer's period end event. Released from the channel's update_pulse_edges.
+static bool volatile dac_latch_armed = false;
+static nrf_ppi_channel_t dac_latch_ppi;
+
+#ifdef DEBUG
+// Entry to exit of dac_request, called from set_power & ramps, which must not wait on the SPI bus.
+static uint32_t volatile dac_request_cycles = 0;
+static uint32_t volatile dac_request_cycles_max = 0;
+#endif
+
+static void dac_batch_next(void);
+
 static void spim_evt_handler(nrfx_spim_evt_t const *p_evt, void *p_context) {
     spim_busy = false;
+    if (dac_queue_running) dac_batch_next();
 }
 
 static void spi_init(void) {
@@ -238,22 +823,40 @@ static void spi_init(void) {
 static void inline enable_channel(uint8_t channel) {
     if (!(channels_active & (1UL << channel))) {
         channels_active |= 1UL << channel;
-        update_pulse_edges(0xFF, 1UL << channel);
+        #if PULSE_OUTPUT_PWM
+        pulse_pwm_start(channel);
+        #else
+        update_pulse_edges(UPDATE_EDGES_DIRECT_CALL, 1UL << channel);
+        #if PULSE_PHASE_INTERLEAVE
+        timer_start(channel);
+        #else
         nrfx_timer_enable(&timers[channel]);
+        #endif
+        #endif
+        update_pulses_request();
     }
 }
 
+static void dac_latch_stopped(uint8_t channel);
+
 static void inline disable_channel(uint8_t channel) {
     if (channels_active & (1UL << channel)) {
         channels_active &= ~(1UL << channel);
+        #if PULSE_OUTPUT_PWM
+        pulse_pwm_stop(channel);
+        #endif
+        // Timer stops, so the period end a latch waits for never comes
+        dac_latch_stopped(channel);
     }
 }
 
 static void dac_set_power(uint16_t power_level, uint8_t channel) {
     // Modulate power level
     power_level = ((POWER_MOD_MAX - (*pulse_states[channel]).power_modulator) * power_level / POWER_MOD_MAX);
+    #if CHARGE_LIMITER
+    dac_levels[channel] = power_level;
+    #endif
 
-    while (spim_busy) { prv_wait(); }
     // Bit numbers in TI datasheet are sent high to low.
     // Set buffer address
     spim_write_buffer[0] = dac_addr_map[channel] | DAC60504_SPI_WRITE;
@@ -268,11 +871,158 @@ static void dac_set_power(uint16_t power_level, uint8_t channel) {
     APP_ERROR_CHECK(err);
 }
 
-// Helper function to be queued to main loop
-static void update_power_level(uint8_t *p_channel) {
-    dac_set_power(power_levels[*p_channel], *p_channel);
+/// First channel of a set, counting round from dac_batch_start.
+static uint8_t dac_batch_first(uint8_t channels) {
+    uint8_t start = dac_batch_start;
+    uint8_t rotated = (channels >> start | channels << (DEVICE_CHANNEL_COUNT - start)) &
+                      ((1UL << DEVICE_CHANNEL_COUNT) - 1);
+    return (start + __builtin_ctz(rotated)) % DEVICE_CHANNEL_COUNT;
+}
+
+static void dac_latch_request(void);
+
+/// Writes the next channel of the batch to the DAC, or latches the batch once every channel is written.
+static void dac_batch_next(void) {
+    uint8_t unwritten = dac_batch_unwritten;
+    if (!unwritten) {
+        dac_latch_request();
+        return;
+    }
+    uint8_t channel = dac_batch_first(unwritten);
+    dac_batch_unwritten = unwritten & ~(1UL << channel);
+    dac_set_power(power_levels[channel], channel);
+}
+
+/**@brief   Takes the next batch of dirty channels, and starts writing it to the DAC.
+ *
+ * A batch is every dirty channel that isn't pulsing, and the next dirty pulsing channel counting round from
+ * dac_batch_start. Runs from interrupts as each batch is latched, so batches chain without the CPU waiting. Channels
+ * made dirty while a batch is written wait for a later one, and power levels are read as each write starts, so the
+ * latest value is sent.
+ */
+static void dac_queue_next(void) {
+    uint8_t batch;
+    CRITICAL_REGION_ENTER();
+    uint8_t dirty = dac_dirty;
+    uint8_t pulsing = dirty & channels_active;
+    batch = dirty & ~channels_active;
+    if (pulsing) batch |= 1UL << dac_batch_first(pulsing);
+    dac_batch = batch;
+    dac_batch_unwritten = batch;
+    dac_dirty = dirty & ~batch;
+    if (!batch) dac_queue_running = false;
+    CRITICAL_REGION_EXIT();
+    if (batch) dac_batch_next();
+}
+
+/// Ends an LDAC pulse started by PPI, or pulses LDAC from software, then moves on to the next batch.
+static void dac_latch_release(void) {
+    nrfx_gpiote_clr_task_trigger(DAC_LDAC_PIN);
+    nrfx_gpiote_set_task_trigger(DAC_LDAC_PIN);
+    dac_queue_next();
+}
+
+/// Latches the written batch at the next period end of its pulsing channel, or straight away if none of it is pulsing.
+static void dac_latch_request(void) {
+    bool latch_now;
+    uint8_t channel = DAC_NO_LATCH;
+    CRITICAL_REGION_ENTER();
+    // A channel enabled since the batch was taken latches with it too, which may fall within its first pulse
+    uint8_t pulsing = dac_batch & channels_active;
+    latch_now = !pulsing;
+    if (!latch_now) {
+        channel = dac_batch_first(pulsing);
+        dac_batch_start = (channel + 1) % DEVICE_CHANNEL_COUNT;
+        dac_latch_armed = false;
+        dac_latch_channel = channel;
+    }
+    CRITICAL_REGION_EXIT();
+    if (latch_now) {
+        dac_latch_release();
+    } else {
+        #if PULSE_OUTPUT_PWM
+        // PWM only interrupts at period ends while a latch waits on them
+        pulse_pwm_period_notify(channel, true);
+        #endif
+    }
+}
+
+/// Event at the end of a channel's pulse period, as its last edge fires.
+static uint32_t period_end_event_address(uint8_t channel) {
+    #if PULSE_OUTPUT_PWM
+    return pulse_pwm_period_end_event_address(channel);
+    #else
+    return nrfx_timer_compare_event_address_get(&timers[channel], programmed_max_index[channel]);
+    #endif
+}
+
+/**@brief   Steps a channel's pending latch at the end of each of its pulse periods.
+ *
+ * Called from update_pulse_edges, after compare values for the next period are programmed. The first period end arms
+ * PPI for the next one, so the latch can't be missed by arming just after a compare event. The second finds LDAC
+ * already latched by hardware, exactly as the last edge of the period fired.
+ */
+static void dac_period_end(uint8_t channel) {
+    if (dac_latch_channel != channel) return;
+    bool latched = false;
+    CRITICAL_REGION_ENTER();
+    if (dac_latch_channel == channel) {
+        if (dac_latch_armed) {
+            dac_latch_channel = DAC_NO_LATCH;
+            latched = true;
+        } else {
+            uint32_t event_addr = period_end_event_address(channel);
+            APP_ERROR_CHECK(nrfx_ppi_channel_assign(dac_latch_ppi, event_addr,
+                                                    nrfx_gpiote_clr_task_addr_get(DAC_LDAC_PIN)));
+            APP_ERROR_CHECK(nrfx_ppi_channel_enable(dac_latch_ppi));
+            dac_latch_armed = true;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+    if (latched) {
+        APP_ERROR_CHECK(nrfx_ppi_channel_disable(dac_latch_ppi));
+        #if PULSE_OUTPUT_PWM
+        pulse_pwm_period_notify(channel, false);
+        #endif
+        dac_latch_release();
+    }
+}
+
+/// Latches a channel whose timer stopped while waiting to latch.
+static void dac_latch_stopped(uint8_t channel) {
+    bool latch_now;
+    CRITICAL_REGION_ENTER();
+    latch_now = dac_latch_channel == channel;
+    if (latch_now) dac_latch_channel = DAC_NO_LATCH;
+    CRITICAL_REGION_EXIT();
+    if (latch_now) {
+        APP_ERROR_CHECK(nrfx_ppi_channel_disable(dac_latch_ppi));
+        #if PULSE_OUTPUT_PWM
+        pulse_pwm_period_notify(channel, false);
+        #endif
+        dac_latch_release();
+    }
+}
+
+/// Queues a channel's DAC output to be written. Never waits on the SPI bus.
+static void dac_request(uint8_t channel) {
+    #ifdef DEBUG
+    uint32_t cycles_start = DWT->CYCCNT;
+    #endif
+    bool start;
+    CRITICAL_REGION_ENTER();
+    dac_dirty |= 1UL << channel;
+    start = !dac_queue_running;
+    dac_queue_running = true;
+    CRITICAL_REGION_EXIT();
+    if (start) dac_queue_next();
+    #ifdef DEBUG
+    dac_request_cycles = DWT->CYCCNT - cycles_start;
+    dac_request_cycles_max = MAX(dac_request_cycles, dac_request_cycles_max);
+    #endif
 }
 
+// Only used during dac_init, before the DAC queue runs.
 static void dac_set_register(uint8_t addr, uint16_t value) {
     // Valid addresses are 0-F
     ASSERT((addr & 0xF0) == 0);
@@ -289,6 +1039,7 @@ static void dac_set_register(uint8_t addr, uint16_t value) {
     APP_ERROR_CHECK(err);
 }
 
+// Only used during dac_init, before the DAC queue runs.
 static uint16_t dac_read(uint8_t reg_addr) {
     spim_write_buffer[0] = reg_addr | DAC60504_SPI_READ;
 
@@ -309,27 +1060,67 @@ static uint16_t dac_read(uint8_t reg_addr) {
 }
 
 static void dac_init(void) {
+    // LDAC idles high, and latches DAC outputs on its falling edge. Driven by GPIOTE tasks, so PPI can pulse it.
+    nrfx_gpiote_out_config_t ldac_config = NRFX_GPIOTE_CONFIG_OUT_TASK_TOGGLE(true);
+    APP_ERROR_CHECK(nrfx_gpiote_out_init(DAC_LDAC_PIN, &ldac_config));
+    nrfx_gpiote_out_task_enable(DAC_LDAC_PIN);
+    APP_ERROR_CHECK(nrfx_ppi_channel_alloc(&dac_latch_ppi));
     spi_init();
     uint16_t device_id = dac_read(DAC60504_DEVICE_ID_REG);
     DEBUG_BREAKPOINT_CHECK(device_id != 0b0010010000010111);
     // Disable 2x gain
     dac_set_register(DAC60504_REG_GAIN, 0x0);
+    // Outputs of all 4 DACs update together on LDAC, rather than each at the end of its own write
+    dac_set_register(DAC60504_REG_SYNC, 0xF);
+    while (spim_busy) { prv_wait(); }
     // TODO: Swap SDO to ALARM, enable CRC
 }
 
 void pulse_init(void) {
+    #ifdef DEBUG
+    // Enable the cycle counter that times pulse interrupts, and update_pulses once patterns_init follows
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    #endif
+    #if PULSE_OUTPUT_PWM
+    pulse_pwm_init(gate_pins, dac_period_end);
+    // LDAC is still driven by GPIOTE
+    nrfx_gpiote_init();
+    #else
     timer_init();
     gate_init();
+    #endif
     dac_init();
     for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
-        pulse_states[channel] = (pulse_state_t *) &pulse_states_store[channel][pulse_states_store[channel]->pv_selector];
+        pulse_states[channel] = &pulse_states_store[channel][pulse_state_slots[channel].read];
+        #if !PULSE_PHASE_INTERLEAVE
         // Add a slight variation in timing between channels to avoid prolonged power spikes w/ no patterns playing.
-        for (int i = 0; i < PULSE_EDGES; ++i) {
-            (*pulse_states[channel]).pulse[i] += channel * 8 /* Arbitrary, based on watching a scope */;
+        for (uint8_t slot = 0; slot < 3; slot++) {
+            for (int i = 0; i < PULSE_EDGES; ++i) {
+                pulse_states_store[channel][slot].pulse[i] += channel * 8 /* Arbitrary, based on watching a scope */;
+            }
+        }
+        #endif
+        #if CHARGE_LIMITER
+        for (uint8_t slot = 0; slot < 3; slot++) {
+            pulse_states_store[channel][slot].charge_on = charge_on_ticks(&pulse_states_store[channel][slot]);
         }
+        #endif
+        #if PULSE_OUTPUT_PWM
+        pwm_update(channel);
+        #endif
     }
 }
 
+#ifdef DEBUG
+void pulse_cycles_log(void) {
+    #if !PULSE_OUTPUT_PWM
+    NRF_LOG_INFO("update_pulse_edges cycles: %u, max %u", update_edges_cycles, update_edges_cycles_max);
+    #endif
+    NRF_LOG_INFO("dac_request cycles: %u, max %u", dac_request_cycles, dac_request_cycles_max);
+}
+#endif
+
 uint8_t max_pulse_index(uint8_t channel) {
     return pulse_states[channel]->max_pulse_index;
 }
@@ -338,29 +1129,334 @@ zappy_pulse_t volatile* pulse_values(uint8_t channel) {
     return &pulse_states[channel]->pulse;
 }
 
-uint16_t set_power(uint8_t channel, uint16_t power_level) {
-    if (power_level == power_levels[channel]) return power_level;
-    power_levels[channel] = power_level = MIN(power_level, MAX_CHANNEL_POWER_LEVEL);
-    dac_set_power(power_level, channel);
+#if POWER_RAMPING
+// Fractional bits of ramping power levels
+#define POWER_RAMP_SHIFT 8
+// Ramp steps per update timer tick. A rate of 0 steps straight to the level set.
+#define POWER_SLEW_STEP ((POWER_SLEW_RATE << POWER_RAMP_SHIFT) / UPDATE_TIMER_FREQ_Hz)
+#define POWER_SOFT_START_STEP ((POWER_SOFT_START_RATE << POWER_RAMP_SHIFT) / UPDATE_TIMER_FREQ_Hz)
+
+// Levels set_power was last asked for, which power_levels ramp up to
+static uint16_t volatile power_targets[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = INITIAL_CHANNEL_POWER};
+// power_levels with fractional steps
+static uint32_t power_ramps[DEVICE_CHANNEL_COUNT] = {
+    [0 ... _CHANNEL_ARR_MAX] = INITIAL_CHANNEL_POWER << POWER_RAMP_SHIFT
+};
+// Channels ramping up, and those of them ramping at the soft-start rate
+static uint8_t volatile power_ramping = 0;
+static uint8_t volatile power_soft_starting = 0;
+#endif
+
+/// Writes a channel's power level to the DAC, and starts or stops its pulses.
+static void power_apply(uint8_t channel, uint16_t power_level) {
+    if (power_level == power_levels[channel]) return;
+    power_levels[channel] = power_level;
     if (power_level > 0) {
+        // Pulsing first, so the write latches at the channel's own period end
         enable_channel(channel);
+        dac_request(channel);
     } else {
+        dac_request(channel);
         disable_channel(channel);
     }
+}
+
+uint16_t set_power(uint8_t channel, uint16_t power_level) {
+    power_level = MIN(power_level, MAX_CHANNEL_POWER_LEVEL);
+    #if POWER_RAMPING
+    bool ramp;
+    CRITICAL_REGION_ENTER();
+    power_targets[channel] = power_level;
+    ramp = power_level > power_levels[channel];
+    if (ramp) {
+        power_ramping |= 1UL << channel;
+    } else {
+        // Drops apply straight away, so a channel can always be turned down at once
+        power_ramping &= ~(1UL << channel);
+        power_soft_starting &= ~(1UL << channel);
+        power_ramps[channel] = power_level << POWER_RAMP_SHIFT;
+    }
+    CRITICAL_REGION_EXIT();
+    if (ramp) return power_levels[channel];
+    #endif
+    power_apply(channel, power_level);
     return power_levels[channel];
 }
 
-void set_pulse(uint8_t channel, zappy_pulse_t const pulse, uint16_t power_mod) {
-    static uint8_t const channels[DEVICE_CHANNEL_COUNT] = {0, 1, 2, 3};
+#if POWER_RAMPING
+void power_ramp_update(void) {
+    uint8_t ramping = power_ramping;
+    while (ramping) {
+        uint8_t channel = __builtin_ctz(ramping);
+        ramping &= ramping - 1;
+        uint16_t power_level;
+        CRITICAL_REGION_ENTER();
+        uint32_t step = power_soft_starting & (1UL << channel) ? POWER_SOFT_START_STEP : POWER_SLEW_STEP;
+        uint32_t target = (uint32_t) power_targets[channel] << POWER_RAMP_SHIFT;
+        uint32_t ramp = step ? MIN(power_ramps[channel] + step, target) : target;
+        power_ramps[channel] = ramp;
+        if (ramp == target) {
+            power_ramping &= ~(1UL << channel);
+            power_soft_starting &= ~(1UL << channel);
+        }
+        power_level = ramp >> POWER_RAMP_SHIFT;
+        CRITICAL_REGION_EXIT();
+        // At most one DAC write per channel per tick, and dac_request coalesces those still queued
+        power_apply(channel, power_level);
+    }
+}
+#endif
+
+#if CHARGE_LIMITER
+// Duty cycles are fractions of 2^CHARGE_DUTY_SHIFT
+#define CHARGE_DUTY_SHIFT 16
+// Scale recovered per update timer tick once under the limits, about 1 s from off to full
+#define CHARGE_RECOVERY_STEP MAX(POWER_MOD_MAX / UPDATE_TIMER_FREQ_Hz, 1)
+// Update timer tick in sixteenths of a microsecond
+#define CHARGE_TICK_SIXTEENTHS (16000000 / UPDATE_TIMER_FREQ_Hz)
+
+#define X(window_ms, mean_limit, rms_limit) \
+    {MAX((window_ms) * UPDATE_TIMER_FREQ_Hz / 1000 / CHARGE_WINDOW_BUCKETS, 1), mean_limit, rms_limit}
+static struct {
+    uint32_t bucket_ticks;
+    uint16_t mean_limit;
+    uint16_t rms_limit;
+} const charge_windows[] = {
+    CHARGE_WINDOW_MAP_X
+};
+#undef X
+#define CHARGE_WINDOW_COUNT (sizeof(charge_windows) / sizeof(charge_windows[0]))
+
+// Share of each channel's power the charge limiter lets through, of POWER_MOD_MAX
+static uint16_t volatile charge_scales[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = POWER_MOD_MAX};
+
+/* Each window is a ring of buckets with a running sum, so a tick adds to one bucket and the sum, and moving on a
+ * bucket takes the oldest out of the sum, whatever the window length.
+ */
+static charge_tally_t charge_buckets[CHARGE_WINDOW_COUNT][DEVICE_CHANNEL_COUNT][CHARGE_WINDOW_BUCKETS];
+static charge_tally_t charge_sums[CHARGE_WINDOW_COUNT][DEVICE_CHANNEL_COUNT];
+// Bucket each window is filling, and ticks tallied into it so far
+static uint8_t charge_bucket_index[CHARGE_WINDOW_COUNT];
+static uint32_t charge_bucket_ticks[CHARGE_WINDOW_COUNT];
+
+/// Limit of a window as a charge_tally_t total over the whole window, from a limit on the mean power level.
+static inline uint64_t charge_budget(uint8_t window, uint32_t level_limit) {
+    return (uint64_t) level_limit * CHARGE_TICK_SIXTEENTHS * charge_windows[window].bucket_ticks *
+           CHARGE_WINDOW_BUCKETS;
+}
+
+static uint32_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1UL << 30; bit; bit >>= 2) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+/// Share of its period a pulse state's gates are on, of 2^CHARGE_DUTY_SHIFT.
+static uint32_t charge_duty(pulse_state_t volatile const *ps) {
+    uint32_t period = ps->pulse[ps->max_pulse_index];
+    if (!period) return 0;
+    return ((uint64_t) MIN(ps->charge_on, period) << CHARGE_DUTY_SHIFT) / period;
+}
+
+/// Power modulator applying a channel's charge scale on top of the modulator its pulse was set with.
+static inline uint32_t charge_modulator(uint8_t channel, uint16_t power_mod) {
+    return POWER_MOD_MAX - (POWER_MOD_MAX - power_mod) * charge_scales[channel] / POWER_MOD_MAX;
+}
+
+/// Republishes a channel's latest pulse with another power modulator, as set_pulse would.
+static void charge_remodulate(uint8_t channel, uint32_t power_modulator) {
+    CRITICAL_REGION_ENTER();
+    pulse_state_t volatile *pulse_state = &pulse_states_store[channel][pulse_state_slots[channel].write];
+    memcpy((void *) pulse_state, (void *) pulse_states[channel], sizeof(pulse_state_t));
+    pulse_state->power_modulator = power_modulator;
+    pulse_state_publish(channel);
+    CRITICAL_REGION_EXIT();
+}
+
+void charge_limit_update(void) {
+    for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+        // Power level the channel would be at unlimited if pulsing, and the share of each period it's delivered in
+        uint32_t level = 0;
+        uint32_t duty = 0;
+        charge_tally_t tally;
+        CRITICAL_REGION_ENTER();
+        if (channels_active & (1UL << channel)) {
+            level = (POWER_MOD_MAX - power_mods[channel]) * power_levels[channel] / POWER_MOD_MAX;
+            duty = charge_duty(pulse_states[channel]);
+        }
+        #if PULSE_OUTPUT_PWM
+        // PWM output has no period interrupt, so the tick is credited with its share of pulse periods instead
+        uint64_t charge = 0;
+        if (level) charge = ((uint64_t) dac_levels[channel] * duty * CHARGE_TICK_SIXTEENTHS) >> CHARGE_DUTY_SHIFT;
+        tally = (charge_tally_t) {.charge = charge, .square = charge * dac_levels[channel]};
+        #else
+        tally = charge_periods[channel];
+        charge_periods[channel] = (charge_tally_t) {0};
+        #endif
+        CRITICAL_REGION_EXIT();
+        uint32_t scale = charge_scales[channel];
+
+        // Scale the channel could keep up within the limits it's over
+        uint32_t sustainable = POWER_MOD_MAX;
+        bool over = false;
+        bool near = false;
+        for (uint8_t window = 0; window < CHARGE_WINDOW_COUNT; window++) {
+            charge_tally_t *bucket = &charge_buckets[window][channel][charge_bucket_index[window]];
+            charge_tally_t *sum = &charge_sums[window][channel];
+            bucket->charge += tally.charge;
+            bucket->square += tally.square;
+            sum->charge += tally.charge;
+            sum->square += tally.square;
+
+            uint32_t mean_limit = charge_windows[window].mean_limit;
+            if (mean_limit) {
+                uint64_t budget = charge_budget(window, mean_limit);
+                if (sum->charge >= budget) {
+                    over = true;
+                    if (level && duty) {
+                        uint64_t limited = ((uint64_t) mean_limit << CHARGE_DUTY_SHIFT) * POWER_MOD_MAX /
+                                           (level * duty);
+                        sustainable = MIN(sustainable, limited);
+                    }
+                } else if (sum->charge >= budget - budget / 8) {
+                    near = true;
+                }
+            }
+            uint32_t rms_limit = charge_windows[window].rms_limit;
+            if (rms_limit) {
+                uint64_t budget = charge_budget(window, rms_limit * rms_limit);
+                if (sum->square >= budget) {
+                    over = true;
+                    if (level && duty) {
+                        // Squares scale with the square of the scale, so the RMS level scales with the scale
+                        uint32_t duty_root = isqrt(MIN((uint64_t) duty << (32 - CHARGE_DUTY_SHIFT), UINT32_MAX));
+                        uint32_t rms_level = level * duty_root >> 16;
+                        if (rms_level) sustainable = MIN(sustainable, rms_limit * POWER_MOD_MAX / rms_level);
+                    }
+                } else if (sum->square >= budget - budget / 8) {
+                    near = true;
+                }
+            }
+        }
+
+        uint32_t next = scale;
+        if (over) {
+            // Held to what the limits allow, and only raised again once under them
+            next = MIN(scale, sustainable);
+        } else if (!near) {
+            next = MIN(scale + CHARGE_RECOVERY_STEP, POWER_MOD_MAX);
+        }
+        if (next != scale) {
+            charge_scales[channel] = next;
+            // Scale reaches the DAC through the power modulator, like a pattern's. Creeping a step per tick mostly
+            // leaves the modulator, and the DAC's level, as they are.
+            uint32_t power_modulator = charge_modulator(channel, power_mods[channel]);
+            if (power_modulator != pulse_states[channel]->power_modulator) {
+                charge_remodulate(channel, power_modulator);
+                uint32_t dac_level = (POWER_MOD_MAX - power_modulator) * power_levels[channel] / POWER_MOD_MAX;
+                if (dac_level != dac_levels[channel]) dac_request(channel);
+            }
+        }
+    }
+
+    for (uint8_t window = 0; window < CHARGE_WINDOW_COUNT; window++) {
+        if (++charge_bucket_ticks[window] < charge_windows[window].bucket_ticks) continue;
+        charge_bucket_ticks[window] = 0;
+        uint8_t index = (charge_bucket_index[window] + 1) % CHARGE_WINDOW_BUCKETS;
+        charge_bucket_index[window] = index;
+        for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+            // Oldest bucket slides out of the window
+            charge_tally_t *bucket = &charge_buckets[window][channel][index];
+            charge_sums[window][channel].charge -= bucket->charge;
+            charge_sums[window][channel].square -= bucket->square;
+            *bucket = (charge_tally_t) {0};
+        }
+    }
+}
+
+uint16_t charge_headroom(uint8_t channel) {
+    // Most used share of any limit, of 0x10000
+    uint32_t used = 0;
+    for (uint8_t window = 0; window < CHARGE_WINDOW_COUNT; window++) {
+        charge_tally_t sum;
+        CRITICAL_REGION_ENTER();
+        sum = charge_sums[window][channel];
+        CRITICAL_REGION_EXIT();
+        uint32_t mean_limit = charge_windows[window].mean_limit;
+        if (mean_limit) {
+            uint64_t share = sum.charge / (charge_budget(window, mean_limit) >> 16);
+            used = MAX(used, MIN(share, 0x10000));
+        }
+        uint32_t rms_limit = charge_windows[window].rms_limit;
+        if (rms_limit) {
+            uint64_t share = sum.square / (charge_budget(window, rms_limit * rms_limit) >> 16);
+            used = MAX(used, MIN(share, 0x10000));
+        }
+    }
+    return MIN(0x10000 - used, 0xFFFF);
+}
+
+uint16_t charge_scale(uint8_t channel) {
+    return charge_scales[channel];
+}
+#endif
+
+#if PULSE_BURST_MIN_GAP_us
+// Burst requested by set_pulse_burst, fitted to each pulse by set_pulse
+static struct {
+    uint8_t count;
+    uint16_t spacing;
+} pulse_bursts[DEVICE_CHANNEL_COUNT] = {[0 ... _CHANNEL_ARR_MAX] = {.count = 1}};
+
+/**@brief   Fits a channel's requested burst to a pulse state.
+ *
+ * Sub-pulses can't overlap, and need PULSE_BURST_MIN_GAP_us between them for the interrupt to move the edges on.
+ * Spacing is widened to fit, then sub-pulses that would start before MIN_PULSE_VALUE are dropped.
+ */
+static void burst_fit(uint8_t channel, pulse_state_t volatile *ps, uint16_t min_ticks) {
+    uint16_t first = UINT16_MAX;
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        if (ps->pulse[i]) first = MIN(first, ps->pulse[i]);
+    }
+    uint32_t count = 1;
+    uint32_t spacing = 0;
+    if (pulse_bursts[channel].count > 1 && first != UINT16_MAX) {
+        spacing = MAX(pulse_bursts[channel].spacing,
+                      ps->pulse[ps->max_pulse_index] - first + us_pulse_ticks(channel, PULSE_BURST_MIN_GAP_us));
+        count = MIN(pulse_bursts[channel].count, 1 + (first - min_ticks) / spacing);
+    }
+    ps->burst_count = count;
+    ps->burst_spacing = count > 1 ? spacing : 0;
+}
+
+void set_pulse_burst(uint8_t channel, uint16_t count, uint16_t spacing) {
+    pulse_bursts[channel].count = MIN(MAX(count, 1), UINT8_MAX);
+    pulse_bursts[channel].spacing = spacing;
+}
+#endif
+
+bool set_pulse(uint8_t channel, zappy_pulse_t const pulse, uint16_t power_mod) {
     #if 0
     NRF_LOG_DEBUG("%*u|%5u, %5u, %5u, %5u|", 27 * channel + 5, power_levels[channel], pulse[0], pulse[1], pulse[2], pulse[3]);
     #endif
-    // Double-buffered writes to avoid race conditions.
-    uint16_t pv_sel = (uint16_t) !((bool) ((pulse_state_t *) pulse_states[channel])->pv_selector);
-    pulse_state_t volatile *pulse_state = &pulse_states_store[channel][pv_sel];
+    uint16_t min_ticks = min_pulse_ticks(channel);
+    // With no edge at or past MIN_PULSE_VALUE nothing would end the period, so the prior pulse plays on
+    if (MAX(MAX(pulse[0], pulse[1]), MAX(pulse[2], pulse[3])) < min_ticks) return false;
+    // Triple-buffered writes to avoid race conditions. Serial commands, patterns & streams all set pulses, from
+    // contexts that preempt each other, so only one at a time fills & publishes the write slot.
+    bool power_changed;
+    CRITICAL_REGION_ENTER();
+    pulse_state_t volatile *pulse_state = &pulse_states_store[channel][pulse_state_slots[channel].write];
     uint8_t max_pulse_index = 0;
     for (int i = 0; i < PULSE_EDGES; ++i) {
-        if (pulse[i] < MIN_PULSE_VALUE) {
+        if (pulse[i] < min_ticks) {
             // Disable pulse values less than minimum
             pulse_state->pulse[i] = 0;
         } else {
@@ -370,29 +1466,98 @@ void set_pulse(uint8_t channel, zappy_pulse_t const pulse, uint16_t power_mod) {
             pulse_state->pulse[i] = pulse[i];
         }
     }
-    pulse_state->power_modulator = power_mod;
     pulse_state->max_pulse_index = max_pulse_index;
-    pulse_state->pv_selector = pv_sel;
-    if (pulse_states[channel]->power_modulator != pulse_state->power_modulator) {
-        app_sched_event_put(&channels[channel], 1, SCHED_FN(update_power_level));
-    }
-    // Update pointer last in single operation to avoid race conditions.
-    pulse_states[channel] = (pulse_state_t *) pulse_state;
+    #if PULSE_BURST_MIN_GAP_us
+    burst_fit(channel, pulse_state, min_ticks);
+    #endif
+    #if CHARGE_LIMITER
+    power_mods[channel] = power_mod;
+    pulse_state->power_modulator = charge_modulator(channel, power_mod);
+    pulse_state->charge_on = charge_on_ticks(pulse_state);
+    #else
+    pulse_state->power_modulator = power_mod;
+    #endif
+    power_changed = pulse_states[channel]->power_modulator != pulse_state->power_modulator;
+    pulse_state_publish(channel);
+    CRITICAL_REGION_EXIT();
+    #if PULSE_OUTPUT_PWM
+    pwm_update(channel);
+    #endif
+    // DAC writes are queued, so the power level can follow the modulator straight away.
+    if (power_changed) dac_request(channel);
 
     // Update intensity values
     pulse_state_t *ps = (pulse_state_t *) pulse_states[channel];
-    uint16_t pulse_max_width = MAX(ps->pulse[1] - ps->pulse[0], ps->pulse[3] - ps->pulse[2]);
+    uint32_t pulse_width = pulse_ticks_us(channel, MAX(ps->pulse[1] - ps->pulse[0], ps->pulse[3] - ps->pulse[2]));
+    #if PULSE_BURST_MIN_GAP_us
+    // Every sub-pulse of a burst adds its width
+    pulse_width *= ps->burst_count;
+    #endif
+    uint16_t pulse_max_width = MIN(pulse_width, UINT16_MAX);
     uint16_t pulse_width_intensity = 0xFFFF * pulse_max_width / MAX_PULSE_WIDTH;
     uint16_t power_mod_intensity = 0xFFFF *
                                    (POWER_MOD_MAX - ps->power_modulator) * power_levels[channel] / POWER_MOD_MAX;
     intensities[channel] = curve_intensity(power_mod_intensity) * curve_intensity(pulse_width_intensity);
+    return true;
+}
+
+void set_pulse_resolution(uint8_t channel, pulse_resolution_t resolution) {
+    if (resolution >= PULSE_RESOLUTION_COUNT || resolution == pulse_resolutions[channel]) return;
+    #if PULSE_OUTPUT_PWM
+    pulse_resolutions[channel] = resolution;
+    pulse_pwm_resolution(channel, resolution);
+    #else
+    // Timer switches at its next max edge, as the gates are off, or as the channel is next enabled
+    pulse_resolutions[channel] = resolution;
+    #endif
+}
+
+pulse_resolution_t pulse_resolution(uint8_t channel) {
+    return pulse_resolutions[channel];
+}
+
+uint16_t min_pulse_ticks(uint8_t channel) {
+    return us_pulse_ticks(channel, MIN_PULSE_VALUE);
+}
+
+uint32_t pulse_ticks_us(uint8_t channel, uint32_t ticks) {
+    return (ticks << resolution_frequencies[pulse_resolutions[channel]]) >> 4;
 }
 
 void pulse_pause(uint8_t channel) {
+    #if POWER_RAMPING
+    // Ramps would restart the channel, so they wait for it to resume
+    CRITICAL_REGION_ENTER();
+    power_ramping &= ~(1UL << channel);
+    power_soft_starting &= ~(1UL << channel);
+    CRITICAL_REGION_EXIT();
+    #endif
     disable_channel(channel);
 }
 
 void pulse_resume(uint8_t channel) {
+    #if POWER_SOFT_START_RATE
+    // Channels still pulsing, such as those switching pattern, carry on at their level
+    bool soft_start = !(channels_active & (1UL << channel));
+    #endif
+    #if POWER_RAMPING
+    CRITICAL_REGION_ENTER();
+    #if POWER_SOFT_START_RATE
+    if (soft_start) {
+        // Soft-start ramps up from off
+        power_ramps[channel] = 0;
+        if (power_targets[channel]) power_soft_starting |= 1UL << channel;
+    }
+    #endif
+    if (power_targets[channel] > power_ramps[channel] >> POWER_RAMP_SHIFT) power_ramping |= 1UL << channel;
+    CRITICAL_REGION_EXIT();
+    #endif
+    #if POWER_SOFT_START_RATE
+    if (soft_start) {
+        power_apply(channel, 0);
+        return;
+    }
+    #endif
     if (power_levels[channel] > 0) {
         enable_channel(channel);
     }
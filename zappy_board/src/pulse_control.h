@@ -5,6 +5,7 @@
 #ifndef PULSE_CONTROL_H
 #define PULSE_CONTROL_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "app_config.h"
@@ -21,13 +22,84 @@ extern uint8_t volatile channels_active;
 
 void pulse_init(void);
 
+#ifdef DEBUG
+/// Logs the most recent & slowest cycle counts of pulse interrupts & DAC requests, scheduled by the update timer.
+void pulse_cycles_log(void);
+#endif
+
 uint8_t max_pulse_index(uint8_t channel);
 
 zappy_pulse_t volatile* pulse_values(uint8_t channel);
 
+/**@brief   Function to set a channel's power level.
+ *
+ * With POWER_SLEW_RATE, rises are ramped toward by power_ramp_update rather than applied straight away.
+ *
+ * @return  Power level the channel is at, which is below the level set while it ramps up to it.
+ */
 uint16_t set_power(uint8_t channel, uint16_t power_level);
 
-void set_pulse(uint8_t channel, zappy_pulse_t const p_pulse, uint16_t power_mod);
+// Power levels ramp from the update timer rather than changing in one DAC write
+#define POWER_RAMPING (POWER_SLEW_RATE || POWER_SOFT_START_RATE)
+
+#if POWER_RAMPING
+/// Steps channels' power levels toward the levels set, called every update timer tick.
+void power_ramp_update(void);
+#endif
+
+#if CHARGE_LIMITER
+/**@brief   Tallies the charge each channel delivered over the last update timer tick, called every tick.
+ *
+ * Timer output adds up the charge of each pulse period as it ends, from the DAC level & the gates' on time. PWM output
+ * has no period interrupt, so its charge is estimated every tick from the duty cycle of the pulse edges. A channel that
+ * goes over a window's limit is scaled down, through its power modulator, to the power it can keep up within that
+ * limit, and recovers slowly once its windows are back under 7/8 of their limits.
+ */
+void charge_limit_update(void);
+
+/// Share left of a channel's most used charge window limit, as a fraction of 0x10000 capped at 0xFFFF.
+uint16_t charge_headroom(uint8_t channel);
+
+/// Scale the charge limiter holds a channel's power to, up to POWER_MOD_MAX for none.
+uint16_t charge_scale(uint8_t channel);
+#endif
+
+/**@brief   Function to set a channel's pulse values, in ticks of its pulse resolution, from its next pulse period.
+ *
+ * Values below MIN_PULSE_VALUE disable their edge, and the max edge ends the period.
+ *
+ * @return  false, leaving the channel's pulse unchanged, if no value is at least MIN_PULSE_VALUE.
+ */
+bool set_pulse(uint8_t channel, zappy_pulse_t const p_pulse, uint16_t power_mod);
+
+#if PULSE_BURST_MIN_GAP_us
+/**@brief   Function to set the burst of sub-pulses a channel plays each pulse period, from its next set_pulse.
+ *
+ * Every sub-pulse repeats the pulse edges, spacing pulse ticks earlier than the next, and the last ends the period.
+ * set_pulse widens spacing so sub-pulses are at least PULSE_BURST_MIN_GAP_us apart, and drops sub-pulses that would
+ * start before MIN_PULSE_VALUE.
+ *
+ * @param[in] channel   Channel to set burst of.
+ * @param[in] count     Sub-pulses per period, at most 255. 0 or 1 plays single pulses.
+ * @param[in] spacing   Time between the starts of consecutive sub-pulses, in pulse ticks.
+ */
+void set_pulse_burst(uint8_t channel, uint16_t count, uint16_t spacing);
+#endif
+
+/**@brief   Function to set the length of the timer ticks a channel's pulse values count.
+ *
+ * Pulses set from now on count the new ticks. The channel timer switches at the end of its current pulse period, with
+ * both gates off, and restarts from the new period.
+ */
+void set_pulse_resolution(uint8_t channel, pulse_resolution_t resolution);
+
+pulse_resolution_t pulse_resolution(uint8_t channel);
+
+/// MIN_PULSE_VALUE in a channel's pulse ticks.
+uint16_t min_pulse_ticks(uint8_t channel);
+
+/// Converts a channel's pulse ticks to microseconds.
+uint32_t pulse_ticks_us(uint8_t channel, uint32_t ticks);
 
 void pulse_pause(uint8_t channel);
 
@@ -0,0 +1,201 @@
+#include <string.h>
+
+#include "pulse_pwm.h"
+#include "pwm_sequence.h"
+#include "prv_utils.h"
+
+#include "app_util_platform.h"
+#include "nrfx_pwm.h"
+
+#if PULSE_OUTPUT_PWM
+
+// Longest single pulse, a 16-bit period at 2 PWM clock ticks per pulse tick, splits into 8 waves, and it can take two
+// periods to return the gates to their starting levels.
+STATIC_ASSERT(PULSE_PWM_SEQUENCE_WAVES >= 16);
+
+static nrfx_pwm_t const pwms[DEVICE_CHANNEL_COUNT] = {
+    NRFX_PWM_INSTANCE(CHANNEL0_PWM_INSTANCE),
+    NRFX_PWM_INSTANCE(CHANNEL1_PWM_INSTANCE),
+    NRFX_PWM_INSTANCE(CHANNEL2_PWM_INSTANCE),
+    NRFX_PWM_INSTANCE(CHANNEL3_PWM_INSTANCE),
+};
+
+// PWM clock for each pulse resolution. The slowest PWM clock is 125 kHz, so 16 us pulse ticks count 2 PWM ticks.
+static struct {
+    nrf_pwm_clk_t clock;
+    uint8_t tick_shift;
+} const pwm_clocks[PULSE_RESOLUTION_COUNT] = {
+    [PULSE_RESOLUTION_1_US] = {NRF_PWM_CLK_1MHz, 0},
+    [PULSE_RESOLUTION_62_5_NS] = {NRF_PWM_CLK_16MHz, 0},
+    [PULSE_RESOLUTION_16_US] = {NRF_PWM_CLK_125kHz, 1},
+};
+
+/**@brief   PWM output state of a channel.
+ *
+ * Sequence 0 & 1 play alternately in a loop. Each holds whole pulse periods, so either one ending is a period
+ * boundary, and the one that just ended can be rebuilt while the other plays.
+ */
+typedef struct {
+    pwm_wave_t waves[2][PULSE_PWM_SEQUENCE_WAVES];
+    zappy_pulse_t pulse;                /**< Latest pulse, built into each sequence as it ends. */
+    uint8_t burst_count;
+    uint16_t burst_spacing;
+    pulse_resolution_t resolution;
+    uint8_t volatile stale;             /**< Sequences not yet rebuilt from the latest pulse, as a bitfield. */
+    bool volatile stopping;             /**< Stop at the next sequence end. */
+    bool volatile notify;               /**< Call period handler at every sequence 0 end. */
+    bool volatile playing;
+} pwm_channel_t;
+
+static pwm_channel_t pwm_channels[DEVICE_CHANNEL_COUNT];
+static pulse_pwm_period_handler_t m_period_handler;
+
+/// Builds one of a channel's sequences from its latest pulse, returning its length in 16-bit values.
+static uint16_t pwm_build(uint8_t channel, uint8_t seq) {
+    pwm_channel_t *c = &pwm_channels[channel];
+    uint8_t tick_shift = pwm_clocks[c->resolution].tick_shift;
+    uint16_t count = pwm_sequence_build(c->waves[seq], PULSE_PWM_SEQUENCE_WAVES, c->pulse,
+                                        c->burst_count, c->burst_spacing, tick_shift);
+    if (!count) {
+        // Burst outgrew the sequence buffer, so play single pulses
+        count = pwm_sequence_build(c->waves[seq], PULSE_PWM_SEQUENCE_WAVES, c->pulse, 1, 0, tick_shift);
+    }
+    return count * sizeof(pwm_wave_t) / sizeof(uint16_t);
+}
+
+/// Enables sequence end interrupts only while a channel has something to do at a sequence end.
+static void pwm_interrupts_update(uint8_t channel) {
+    pwm_channel_t *c = &pwm_channels[channel];
+    NRF_PWM_Type *p_reg = pwms[channel].p_reg;
+    if (c->playing && (c->stale || c->stopping || c->notify)) {
+        if (!nrf_pwm_int_enable_check(p_reg, NRF_PWM_INT_SEQEND0_MASK)) {
+            // Events from while interrupts were off are old, and would rebuild a sequence as it plays
+            nrf_pwm_event_clear(p_reg, NRF_PWM_EVENT_SEQEND0);
+            nrf_pwm_event_clear(p_reg, NRF_PWM_EVENT_SEQEND1);
+            nrf_pwm_int_enable(p_reg, NRF_PWM_INT_SEQEND0_MASK | NRF_PWM_INT_SEQEND1_MASK);
+        }
+    } else {
+        nrf_pwm_int_disable(p_reg, NRF_PWM_INT_SEQEND0_MASK | NRF_PWM_INT_SEQEND1_MASK);
+    }
+}
+
+static void pwm_evt_handler(uint8_t channel, nrfx_pwm_evt_type_t event_type) {
+    pwm_channel_t *c = &pwm_channels[channel];
+    // Events left from before a stop are reported with the stop
+    if (!c->playing) return;
+    if (event_type != NRFX_PWM_EVT_END_SEQ0 && event_type != NRFX_PWM_EVT_END_SEQ1) return;
+    uint8_t seq = event_type == NRFX_PWM_EVT_END_SEQ0 ? 0 : 1;
+    if (c->stopping) {
+        // The next sequence starts with the gates off, so the PWM period it stops in never cuts a pulse short
+        c->stopping = false;
+        c->playing = false;
+        nrfx_pwm_stop(&pwms[channel], false);
+    } else if (c->stale & (1U << seq)) {
+        c->stale &= ~(1U << seq);
+        nrf_pwm_seq_cnt_set(pwms[channel].p_reg, seq, pwm_build(channel, seq));
+    }
+    if (seq == 0 && c->notify) m_period_handler(channel);
+    pwm_interrupts_update(channel);
+}
+
+// nrfx PWM handlers aren't passed their instance
+#define PWM_EVT_HANDLER(channel) \
+static void pwm_evt_handler_ ## channel(nrfx_pwm_evt_type_t event_type) { pwm_evt_handler(channel, event_type); }
+PWM_EVT_HANDLER(0)
+PWM_EVT_HANDLER(1)
+PWM_EVT_HANDLER(2)
+PWM_EVT_HANDLER(3)
+static nrfx_pwm_handler_t const pwm_evt_handlers[DEVICE_CHANNEL_COUNT] = {
+    pwm_evt_handler_0,
+    pwm_evt_handler_1,
+    pwm_evt_handler_2,
+    pwm_evt_handler_3,
+};
+
+void pulse_pwm_init(uint32_t const gate_pins[DEVICE_CHANNEL_COUNT][2], pulse_pwm_period_handler_t period_handler) {
+    m_period_handler = period_handler;
+    for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+        nrfx_pwm_config_t config = NRFX_PWM_DEFAULT_CONFIG;
+        config.output_pins[0] = gate_pins[channel][0];
+        config.output_pins[1] = gate_pins[channel][1];
+        config.output_pins[2] = NRFX_PWM_PIN_NOT_USED;
+        config.output_pins[3] = NRFX_PWM_PIN_NOT_USED;
+        config.irq_priority = PULSE_UPDATES_IRQ_PRIORITY;
+        config.base_clock = pwm_clocks[PULSE_RESOLUTION_1_US].clock;
+        config.count_mode = NRF_PWM_MODE_UP;
+        config.top_value = PWM_TOP_MAX;
+        // Every wave sets its own PWM period, so pulse edges needn't fall on a fixed grid
+        config.load_mode = NRF_PWM_LOAD_WAVE_FORM;
+        config.step_mode = NRF_PWM_STEP_AUTO;
+        APP_ERROR_CHECK(nrfx_pwm_init(&pwms[channel], &config, pwm_evt_handlers[channel]));
+        pwm_channels[channel].resolution = PULSE_RESOLUTION_1_US;
+        pwm_channels[channel].burst_count = 1;
+    }
+}
+
+void pulse_pwm_start(uint8_t channel) {
+    pwm_channel_t *c = &pwm_channels[channel];
+    // A stop from the last sequence end may still be waiting for its PWM period to end
+    if (!c->playing) nrfx_pwm_stop(&pwms[channel], true);
+    CRITICAL_REGION_ENTER();
+    c->stopping = false;
+    if (!c->playing) {
+        nrf_pwm_configure(pwms[channel].p_reg, pwm_clocks[c->resolution].clock, NRF_PWM_MODE_UP, PWM_TOP_MAX);
+        nrf_pwm_sequence_t const seq0 = {
+            .values.p_wave_form = (nrf_pwm_values_wave_form_t *) c->waves[0],
+            .length = pwm_build(channel, 0),
+        };
+        nrf_pwm_sequence_t const seq1 = {
+            .values.p_wave_form = (nrf_pwm_values_wave_form_t *) c->waves[1],
+            .length = pwm_build(channel, 1),
+        };
+        c->stale = 0;
+        nrfx_pwm_complex_playback(&pwms[channel], &seq0, &seq1, 1,
+                                  NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_SIGNAL_END_SEQ0 | NRFX_PWM_FLAG_SIGNAL_END_SEQ1);
+        c->playing = true;
+    }
+    pwm_interrupts_update(channel);
+    CRITICAL_REGION_EXIT();
+}
+
+void pulse_pwm_stop(uint8_t channel) {
+    CRITICAL_REGION_ENTER();
+    if (pwm_channels[channel].playing) pwm_channels[channel].stopping = true;
+    pwm_interrupts_update(channel);
+    CRITICAL_REGION_EXIT();
+}
+
+void pulse_pwm_set(uint8_t channel, zappy_pulse_t const pulse, uint8_t burst_count, uint16_t burst_spacing) {
+    pwm_channel_t *c = &pwm_channels[channel];
+    CRITICAL_REGION_ENTER();
+    memcpy(c->pulse, pulse, sizeof(zappy_pulse_t));
+    c->burst_count = burst_count;
+    c->burst_spacing = burst_spacing;
+    c->stale = 0x3;
+    pwm_interrupts_update(channel);
+    CRITICAL_REGION_EXIT();
+}
+
+void pulse_pwm_resolution(uint8_t channel, pulse_resolution_t resolution) {
+    pwm_channel_t *c = &pwm_channels[channel];
+    c->resolution = resolution;
+    if (c->playing) {
+        // PWM clock only changes while stopped
+        c->playing = false;
+        nrfx_pwm_stop(&pwms[channel], true);
+        pulse_pwm_start(channel);
+    }
+}
+
+void pulse_pwm_period_notify(uint8_t channel, bool enable) {
+    CRITICAL_REGION_ENTER();
+    pwm_channels[channel].notify = enable;
+    pwm_interrupts_update(channel);
+    CRITICAL_REGION_EXIT();
+}
+
+uint32_t pulse_pwm_period_end_event_address(uint8_t channel) {
+    return nrf_pwm_event_address_get(pwms[channel].p_reg, NRF_PWM_EVENT_SEQEND0);
+}
+
+#endif
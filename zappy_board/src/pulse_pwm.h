@@ -0,0 +1,43 @@
+#ifndef PULSE_PWM_H
+#define PULSE_PWM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "app_config.h"
+#include "patterns.h"
+
+#if PULSE_OUTPUT_PWM
+
+/// Called at the end of sequence 0 of a channel, a pulse period boundary, while notification is on.
+typedef void (*pulse_pwm_period_handler_t)(uint8_t channel);
+
+/**@brief   Function to initialize the PWM pulse output backend, one PWM instance per channel.
+ *
+ * Each channel plays its pulse as a looping pair of EasyDMA sequences built by pwm_sequence_build, so steady pulses
+ * need no CPU. A new pulse rebuilds each sequence as the other plays, from interrupts that are only enabled until
+ * both are rebuilt.
+ */
+void pulse_pwm_init(uint32_t const gate_pins[DEVICE_CHANNEL_COUNT][2], pulse_pwm_period_handler_t period_handler);
+
+/// Starts a channel playing its latest pulse.
+void pulse_pwm_start(uint8_t channel);
+
+/// Stops a channel at the end of the sequence playing, so the last pulse period finishes.
+void pulse_pwm_stop(uint8_t channel);
+
+/// Sets a channel's pulse, played from the next sequence boundary after it's rebuilt.
+void pulse_pwm_set(uint8_t channel, zappy_pulse_t const pulse, uint8_t burst_count, uint16_t burst_spacing);
+
+/// Sets a channel's pulse ticks. A playing channel restarts, so the current pulse period is cut short.
+void pulse_pwm_resolution(uint8_t channel, pulse_resolution_t resolution);
+
+/// Turns on or off calls to the period handler for a channel.
+void pulse_pwm_period_notify(uint8_t channel, bool enable);
+
+/// Event at the end of a channel's sequence 0, for PPI.
+uint32_t pulse_pwm_period_end_event_address(uint8_t channel);
+
+#endif
+
+#endif //PULSE_PWM_H
@@ -0,0 +1,83 @@
+#include "pwm_sequence.h"
+
+// Returned by builder steps once the sequence outgrows its buffer.
+#define PWM_SEQUENCE_OVERFLOW UINT16_MAX
+
+typedef struct {
+    pwm_wave_t *p_waves;
+    uint16_t capacity;
+    uint16_t count;
+    bool gates[2];          /**< Gate levels at the current position. */
+} pwm_builder_t;
+
+/// Appends PWM periods holding the current gate levels for ticks.
+static void pwm_hold(pwm_builder_t *b, uint32_t ticks) {
+    uint16_t gates[2] = {b->gates[0] ? PWM_GATE_ON : PWM_GATE_OFF, b->gates[1] ? PWM_GATE_ON : PWM_GATE_OFF};
+    if (b->count && b->count != PWM_SEQUENCE_OVERFLOW && b->p_waves[b->count - 1].gates[0] == gates[0]
+        && b->p_waves[b->count - 1].gates[1] == gates[1]) {
+        // Coincident edges left the gates as they were, so the previous run carries on
+        ticks += b->p_waves[--b->count].top;
+    }
+    while (ticks && b->count != PWM_SEQUENCE_OVERFLOW) {
+        uint32_t top = ticks;
+        if (top > PWM_TOP_MAX) {
+            // Split so the remainder isn't left too short for a PWM period of its own
+            top = ticks - PWM_TOP_MAX < PWM_TOP_MIN ? ticks / 2 : PWM_TOP_MAX;
+        }
+        if (top < PWM_TOP_MIN) top = PWM_TOP_MIN;
+        if (b->count == b->capacity) {
+            b->count = PWM_SEQUENCE_OVERFLOW;
+            return;
+        }
+        b->p_waves[b->count++] = (pwm_wave_t) {
+            .gates = {gates[0], gates[1]},
+            .unused = PWM_GATE_OFF,
+            .top = top,
+        };
+        ticks -= top < ticks ? top : ticks;
+    }
+}
+
+/// Appends one pulse period, toggling gates at each edge of every sub-pulse.
+static void pwm_period(pwm_builder_t *b, uint8_t const order[], uint8_t edges, zappy_pulse_t const pulse,
+                       uint8_t burst_count, uint16_t burst_spacing, uint8_t tick_shift) {
+    uint32_t position = 0;
+    for (uint8_t sub_pulse = burst_count; sub_pulse-- > 0;) {
+        // Sub-pulses count down to the last, which ends the period
+        uint32_t backoff = (uint32_t) sub_pulse * burst_spacing;
+        for (uint8_t i = 0; i < edges; i++) {
+            uint32_t edge = (pulse[order[i]] - backoff) << tick_shift;
+            if (edge > position) {
+                pwm_hold(b, edge - position);
+                position = edge;
+            }
+            b->gates[order[i] / 2] = !b->gates[order[i] / 2];
+        }
+    }
+}
+
+uint16_t pwm_sequence_build(pwm_wave_t *p_waves, uint16_t capacity, zappy_pulse_t const pulse,
+                            uint8_t burst_count, uint16_t burst_spacing, uint8_t tick_shift) {
+    pwm_builder_t b = {.p_waves = p_waves, .capacity = capacity, .count = 0, .gates = {false, false}};
+    // Enabled edges in time order
+    uint8_t order[PULSE_EDGES];
+    uint8_t edges = 0;
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        if (!pulse[i]) continue;
+        uint8_t j = edges++;
+        for (; j > 0 && pulse[order[j - 1]] > pulse[i]; j--) order[j] = order[j - 1];
+        order[j] = i;
+    }
+    if (!edges) {
+        // Nothing to play, gates stay off
+        pwm_hold(&b, PWM_TOP_MAX);
+    } else {
+        if (burst_count < 1) burst_count = 1;
+        pwm_period(&b, order, edges, pulse, burst_count, burst_spacing, tick_shift);
+        if (b.gates[0] || b.gates[1]) {
+            // Gates are left toggled, so the next period turns them back
+            pwm_period(&b, order, edges, pulse, burst_count, burst_spacing, tick_shift);
+        }
+    }
+    return b.count == PWM_SEQUENCE_OVERFLOW ? 0 : b.count;
+}
@@ -0,0 +1,52 @@
+#ifndef PWM_SEQUENCE_H
+#define PWM_SEQUENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "patterns.h"
+
+// PWM COUNTERTOP range, in PWM clock ticks.
+#define PWM_TOP_MIN 3
+#define PWM_TOP_MAX 0x7FFF
+
+/* Counting up, the PWM counter starts each PWM period with an output low if its compare value's polarity bit (15) is
+ * clear, or high if it's set, and flips it on reaching the compare value. A compare value of 0 flips it straight away,
+ * so 0x0000 holds a gate high and 0x8000 holds it low for the whole PWM period. Gates are active high and idle low,
+ * as with the pulse timers.
+ */
+#define PWM_GATE_ON     0x0000
+#define PWM_GATE_OFF    0x8000
+
+/**@brief   One PWM period, laid out as EasyDMA reads nrf_pwm_values_wave_form_t in NRF_PWM_LOAD_WAVE_FORM mode. */
+typedef struct {
+    uint16_t gates[2];      /**< Gate A & B compare values, PWM_GATE_ON or PWM_GATE_OFF. */
+    uint16_t unused;        /**< Third output, not connected. */
+    uint16_t top;           /**< Length of this PWM period, in PWM clock ticks. */
+} pwm_wave_t;
+
+/**@brief   Function to build the PWM sequence of a pulse, which repeats the pulse every period when played in a loop.
+ *
+ * Each run of constant gate levels between pulse edges becomes a PWM period, so the PWM peripheral plays whole pulse
+ * trains without the CPU. Edges toggle gates like the pulse timers do: edges 0 & 1 toggle gate A, 2 & 3 gate B,
+ * disabled (0) edges don't toggle, and the last edge ends the period. Pulses that leave a gate toggled build two
+ * periods, so the sequence ends with the gates as it starts.
+ *
+ * Edges that leave the gates as they were don't end a run. Runs longer than PWM_TOP_MAX are split, and runs shorter
+ * than PWM_TOP_MIN are lengthened to it.
+ *
+ * Has no SDK dependencies, so it also builds on a host, see test/test_pwm_sequence.c.
+ *
+ * @param[out] p_waves          Sequence buffer.
+ * @param[in]  capacity         Waves p_waves holds.
+ * @param[in]  pulse            Pulse edges, in pulse ticks.
+ * @param[in]  burst_count      Sub-pulses per period, see set_pulse_burst. Sub-pulses mustn't overlap.
+ * @param[in]  burst_spacing    Time between the starts of consecutive sub-pulses, in pulse ticks.
+ * @param[in]  tick_shift       PWM clock ticks per pulse tick, as a power of 2.
+ *
+ * @return  Waves written, or 0 if the sequence doesn't fit in capacity.
+ */
+uint16_t pwm_sequence_build(pwm_wave_t *p_waves, uint16_t capacity, zappy_pulse_t const pulse,
+                            uint8_t burst_count, uint16_t burst_spacing, uint8_t tick_shift);
+
+#endif //PWM_SEQUENCE_H
@@ -0,0 +1,26 @@
+#ifndef RECIPROCAL_H
+#define RECIPROCAL_H
+
+#include <stdint.h>
+
+/**@brief   Fixed-point reciprocal, so repeated divisions become a multiply and a shift.
+ *
+ * For a divisor d, mul = ceil(2^shift / d) where shift = 31 + floor(log2(d)), keeping mul within [2^30, 2^31].
+ */
+typedef struct {
+    uint32_t mul;
+    uint8_t shift;
+} reciprocal_t;
+
+static inline reciprocal_t reciprocal(uint32_t d) {
+    if (!d) return (reciprocal_t) {0, 31};
+    uint8_t shift = 31 + (31 - __builtin_clz(d));
+    return (reciprocal_t) {.mul = (uint32_t) (((1ULL << shift) + d - 1) / d), .shift = shift};
+}
+
+/// Computes x * 2^frac_bits / d, where mul & shift are the reciprocal of d. No divide instruction required.
+static inline uint32_t recip_scale(uint32_t x, uint32_t mul, uint8_t shift, uint8_t frac_bits) {
+    return (uint32_t) (((uint64_t) x * mul) >> (shift - frac_bits));
+}
+
+#endif //RECIPROCAL_H
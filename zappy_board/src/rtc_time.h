@@ -0,0 +1,45 @@
+#ifndef RTC_TIME_H
+#define RTC_TIME_H
+
+#include <stdint.h>
+
+/// The RTC COUNTER register is 24 bits.
+#define RTC_COUNTER_MASK 0x00FFFFFFUL
+
+/// Each tick of the 32768 Hz RTC is (15625 * (prescaler + 1) / 512) us, exactly.
+#define RTC_TICK_US_NUM(prescaler) (15625ULL * ((prescaler) + 1))
+#define RTC_TICK_US_SHIFT 9
+
+/**@brief   RTC counter extended past its 24 bits, so time is kept across counter overflows. */
+typedef struct {
+    uint64_t ticks;         /**< RTC ticks counted. */
+    uint32_t last_count;    /**< RTC counter when last updated. */
+} rtc_time_t;
+
+/**@brief   Function to count the RTC ticks since the last update.
+ *
+ * Must be called at least once every counter overflow, 512 s at prescaler 0.
+ *
+ * @return  RTC ticks counted in total.
+ */
+static inline uint64_t rtc_time_update(rtc_time_t *p_time, uint32_t count) {
+    p_time->ticks += (count - p_time->last_count) & RTC_COUNTER_MASK;
+    p_time->last_count = count;
+    return p_time->ticks;
+}
+
+/**@brief   Function to convert a total of RTC ticks to microseconds, wrapping every 2^32 microseconds.
+ *
+ * Converting totals rather than increments rounds down once, so no fractional microseconds are lost between calls.
+ */
+static inline uint32_t rtc_ticks_us(uint64_t ticks, uint32_t prescaler) {
+    return (uint32_t) ((ticks * RTC_TICK_US_NUM(prescaler)) >> RTC_TICK_US_SHIFT);
+}
+
+/// Converts microseconds to RTC ticks, rounding up.
+static inline uint32_t rtc_us_ticks(uint32_t us, uint32_t prescaler) {
+    return (uint32_t) ((((uint64_t) us << RTC_TICK_US_SHIFT) + RTC_TICK_US_NUM(prescaler) - 1)
+                       / RTC_TICK_US_NUM(prescaler));
+}
+
+#endif //RTC_TIME_H
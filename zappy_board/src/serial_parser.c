@@ -9,6 +9,8 @@
 #include "storage.h"
 #include "pattern_control.h"
 #include "pulse_control.h"
+#include "playlist.h"
+#include "stream.h"
 #include "board2board_host.h"
 #include "usb_serial.h"
 #include "audio_adc.h"
@@ -103,12 +105,55 @@ size_t serial_parse(uint8_t *p_data, size_t length, prv_serial_response_t serial
             zappy_pulse_t *input_pulse = (zappy_pulse_t *) command->payload;
             for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
                 if (command->channels & (1UL << channel)) {
-                    set_pulse(channel, *input_pulse, 0);
+                    if (!set_pulse(channel, *input_pulse, 0)) {
+                        response->retcode = OP_ERROR_PARSE_ERROR;
+                        break;
+                    }
+                    response->retcode = OP_SUCCESS;
+                }
+            }
+        }
+            break;
+        case OP_SET_PULSE_RESOLUTION: {
+            REQUIRE_LENGTH(sizeof(uint16_t));
+            uint16_t resolution = *(uint16_t *) command->payload;
+            if (resolution >= PULSE_RESOLUTION_COUNT) {
+                response->retcode = OP_ERROR_PARSE_ERROR;
+                break;
+            }
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (command->channels & (1UL << channel)) {
+                    set_pulse_resolution(channel, resolution);
+                    response->retcode = OP_SUCCESS;
+                }
+            }
+        }
+            break;
+        #if PULSE_BURST_MIN_GAP_us
+        case OP_SET_PULSE_BURST: {
+            REQUIRE_LENGTH(sizeof(zappy_burst_msg_t));
+            zappy_burst_msg_t *input_burst = (zappy_burst_msg_t *) command->payload;
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (command->channels & (1UL << channel)) {
+                    set_pulse_burst(channel, input_burst->count, input_burst->spacing);
                     response->retcode = OP_SUCCESS;
                 }
             }
         }
             break;
+        #endif
+        #if CHARGE_LIMITER
+        case OP_GET_CHARGE_HEADROOM: {
+            zappy_charge_status_t *output_status = (zappy_charge_status_t *) response->payload;
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                output_status[channel].headroom = charge_headroom(channel);
+                output_status[channel].scale = charge_scale(channel);
+            }
+            response->retcode = OP_SUCCESS;
+            response_length += DEVICE_CHANNEL_COUNT * sizeof(zappy_charge_status_t);
+        }
+            break;
+        #endif
         case OP_GET_POWERS: {
             memcpy((void *) response->payload, (void *) power_levels, sizeof(zappy_power_levels_t));
             response->retcode = OP_SUCCESS;
@@ -150,6 +195,7 @@ size_t serial_parse(uint8_t *p_data, size_t length, prv_serial_response_t serial
                 }
             }
             if (response->retcode == OP_SUCCESS) {
+                update_pulses_request();
                 response_length += sizeof(zappy_pattern_adjusts_t);
                 FORWARD(p_data, length);
             }
@@ -158,23 +204,32 @@ size_t serial_parse(uint8_t *p_data, size_t length, prv_serial_response_t serial
         case OP_PLAY_PATTERN: {
             REQUIRE_LENGTH(sizeof(pattern_index_t));
             pattern_index_t index = ((pattern_index_t *) command->payload)[0];
+            // Channels the patterns started on, including every track of multi-track patterns
+            uint32_t playing = 0;
             for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
                 if (command->channels & (1UL << channel)) {
+                    playlist_stop(channel);
                     nrfx_err_t err = pattern_play(channel, index);
                     switch (err) {
                         case NRFX_ERROR_INVALID_ADDR:
                             response->retcode = OP_ERROR_INVALID_INDEX;
                             break;
+                        case NRFX_ERROR_INVALID_PARAM:
+                            response->retcode = OP_ERROR_PARSE_ERROR;
+                            break;
                         case NRFX_SUCCESS:
                             response->retcode = OP_SUCCESS;
+                            playing |= pattern_channels(channel, index);
                             break;
                         default:
                             APP_ERROR_CHECK(err);
                             break;
                     }
-                    pulse_resume(channel);
                 }
             }
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (playing & (1UL << channel)) pulse_resume(channel);
+            }
             if (response->retcode == OP_SUCCESS) {
                 FORWARD(p_data, length);
             }
@@ -220,6 +275,138 @@ size_t serial_parse(uint8_t *p_data, size_t length, prv_serial_response_t serial
             }
         }
             break;
+        #if PATTERN_LAYER_COUNT
+        case OP_PLAY_LAYER: {
+            REQUIRE_LENGTH(sizeof(zappy_layer_msg_t));
+            zappy_layer_msg_t *input_layer = (zappy_layer_msg_t *) command->payload;
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (command->channels & (1UL << channel)) {
+                    nrfx_err_t err = pattern_layer_play(channel, input_layer->layer, input_layer->index,
+                                                        input_layer->edges, input_layer->power);
+                    switch (err) {
+                        case NRFX_ERROR_INVALID_ADDR:
+                            response->retcode = OP_ERROR_INVALID_INDEX;
+                            break;
+                        case NRFX_ERROR_INVALID_PARAM:
+                            response->retcode = OP_ERROR_PARSE_ERROR;
+                            break;
+                        case NRFX_SUCCESS:
+                            response->retcode = OP_SUCCESS;
+                            break;
+                        default:
+                            APP_ERROR_CHECK(err);
+                            break;
+                    }
+                }
+            }
+            if (response->retcode == OP_SUCCESS) {
+                FORWARD(p_data, length);
+            }
+        }
+            break;
+        #endif
+        case OP_GET_PLAYLIST: {
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                // Only returns the first channel found
+                if (command->channels & (1UL << channel)) {
+                    memcpy((void *) response->payload, playlist_get(channel), sizeof(zappy_playlist_t));
+                    response->channels = 1UL << channel;
+                    response_length += sizeof(zappy_playlist_t);
+                    break;
+                }
+            }
+        }
+            break;
+        case OP_SET_PLAYLIST: {
+            REQUIRE_LENGTH(sizeof(zappy_playlist_t));
+            zappy_playlist_t *input_playlist = (zappy_playlist_t *) command->payload;
+            // Channels the playlists' first patterns started on, including every track of multi-track patterns
+            uint32_t playing = 0;
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (command->channels & (1UL << channel)) {
+                    nrfx_err_t err = playlist_play(channel, input_playlist);
+                    switch (err) {
+                        case NRFX_ERROR_INVALID_ADDR:
+                            response->retcode = OP_ERROR_INVALID_INDEX;
+                            break;
+                        case NRFX_ERROR_INVALID_PARAM:
+                        case NRFX_ERROR_INVALID_STATE:
+                            response->retcode = OP_ERROR_PARSE_ERROR;
+                            break;
+                        case NRFX_SUCCESS:
+                            response->retcode = OP_SUCCESS;
+                            playing |= input_playlist->entry_count ?
+                                       pattern_channels(channel, input_playlist->entries[0].index) : 1UL << channel;
+                            break;
+                        default:
+                            APP_ERROR_CHECK(err);
+                            break;
+                    }
+                }
+            }
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (playing & (1UL << channel)) pulse_resume(channel);
+            }
+            if (response->retcode == OP_SUCCESS) {
+                FORWARD(p_data, length);
+            }
+        }
+            break;
+        #if STREAM_BUFFER_ELEMENTS
+        case OP_STREAM_ELEMENTS: {
+            REQUIRE_LENGTH(sizeof(zappy_stream_msg_t));
+            zappy_stream_msg_t *input_stream = (zappy_stream_msg_t *) command->payload;
+            if (input_stream->count > STREAM_MSG_MAX_ELEMENTS) {
+                response->retcode = OP_ERROR_PARSE_ERROR;
+                break;
+            }
+            REQUIRE_LENGTH(input_stream->count * sizeof(zappy_stream_element_t));
+            zappy_stream_status_t *output_status = (zappy_stream_status_t *) response->payload;
+            for (uint8_t channel = DEVICE_CHANNEL_COUNT; channel-- > 0;) {
+                // Status of the lowest channel is returned
+                if (command->channels & (1UL << channel)) {
+                    if (!stream_active(channel)) {
+                        playlist_stop(channel);
+                        pulse_resume(channel);
+                    }
+                    stream_push(channel, input_stream->latency, input_stream->elements, input_stream->count,
+                                output_status);
+                    response->channels = 1UL << channel;
+                }
+            }
+            if (response->retcode != OP_NOOP) {
+                response_length += sizeof(zappy_stream_status_t);
+                FORWARD(p_data, length);
+            }
+        }
+            break;
+        #endif
+        case OP_GET_PATTERN_PROGRESS: {
+            refresh_pattern_progress();
+            memcpy((void *) response->payload, pattern_progress, sizeof(zappy_pattern_progress_t));
+            response->retcode = OP_SUCCESS;
+            response_length += sizeof(zappy_pattern_progress_t);
+        }
+            break;
+        case OP_SET_PATTERN_PROGRESS: {
+            REQUIRE_LENGTH(sizeof(zappy_pattern_progress_t));
+            zappy_pattern_progress_t *input_progress = (zappy_pattern_progress_t *) command->payload;
+            zappy_pattern_progress_t *output_progress = (zappy_pattern_progress_t *) response->payload;
+            memset(output_progress, 0, sizeof(zappy_pattern_progress_t));
+            for (uint8_t channel = 0; channel < DEVICE_CHANNEL_COUNT; channel++) {
+                if (command->channels & (1UL << channel)) {
+                    if (pattern_seek(channel, (*input_progress)[channel]) == NRFX_SUCCESS) {
+                        (*output_progress)[channel] = pattern_progress[channel];
+                        response->retcode = OP_SUCCESS;
+                    }
+                }
+            }
+            if (response->retcode == OP_SUCCESS) {
+                response_length += sizeof(zappy_pattern_progress_t);
+                FORWARD(p_data, length);
+            }
+        }
+            break;
         case OP_INSERT_PATTERN: {
             pattern_index_t idx = (pattern_index_t) command->index;
             zappy_pattern_t *p_pattern = (zappy_pattern_t *) command->payload;
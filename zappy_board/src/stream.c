@@ -0,0 +1,166 @@
+#include <stdlib.h>
+
+#include "stream.h"
+#include "pattern_control.h"
+#include "pulse_control.h"
+#include "easing.h"
+#include "reciprocal.h"
+#include "timers.h"
+
+#if STREAM_BUFFER_ELEMENTS
+
+// Indices are free-running and wrap with uint16_t, so the buffer size must divide 0x10000.
+STATIC_ASSERT((STREAM_BUFFER_ELEMENTS & (STREAM_BUFFER_ELEMENTS - 1)) == 0);
+#define STREAM_INDEX_MASK (STREAM_BUFFER_ELEMENTS - 1)
+
+/**@brief   Ring buffer of streamed elements for a channel.
+ *
+ * stream_push is the only writer of head, and stream_update the only writer of tail, so neither needs locking.
+ */
+typedef struct {
+    zappy_stream_element_t elements[STREAM_BUFFER_ELEMENTS];
+    uint16_t volatile head;         /**< Count of elements pushed. */
+    uint16_t volatile tail;         /**< Count of elements played past. elements[tail] is playing. */
+    bool volatile active;
+    bool anchored;                  /**< Element timestamps are mapped to us_timestamp. */
+    uint32_t anchor_timestamp;      /**< Element timestamp played at anchor_time, in milliseconds. */
+    uint32_t anchor_time;           /**< us_timestamp anchor_timestamp plays at. */
+    uint32_t latency;               /**< Latency target, in microseconds. */
+    reciprocal_t recip;             /**< Reciprocal of the playing element's duration. */
+    uint16_t underruns;             /**< Times playback ran out of elements. */
+} stream_t;
+
+static stream_t streams[DEVICE_CHANNEL_COUNT];
+
+static inline zappy_stream_element_t const *stream_element(stream_t const *s, uint16_t index) {
+    return &s->elements[index & STREAM_INDEX_MASK];
+}
+
+/// us_timestamp an element starts playing at.
+static inline uint32_t stream_element_time(stream_t const *s, zappy_stream_element_t const *p_element) {
+    return s->anchor_time + (p_element->timestamp - s->anchor_timestamp) * 1000;
+}
+
+/// Mixes an element and the one after it by level, a percentage of EASING_ONE, and outputs the result.
+static void stream_output(uint8_t channel, zappy_pattern_element_t const *p_element,
+                          zappy_pattern_element_t const *p_next_element, int32_t level) {
+    zappy_pulse_t pulse;
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        int32_t value = p_element->pulse[i] + (((p_next_element->pulse[i] - p_element->pulse[i]) * level) >> 14);
+        pulse[i] = MIN(MAX(value, 0), UINT16_MAX);
+    }
+    int32_t power_modulator = p_element->power_modulator +
+                              (((p_next_element->power_modulator - p_element->power_modulator) * level) >> 14);
+    set_pulse(channel, pulse, MIN(MAX(power_modulator, 0), POWER_MOD_MAX));
+}
+
+/// Time for a transition to change output by one unit, in microseconds.
+static uint32_t stream_step_interval(zappy_pattern_element_t const *p_element,
+                                     zappy_pattern_element_t const *p_next_element, uint32_t duration) {
+    uint32_t max_delta = abs(p_next_element->power_modulator - p_element->power_modulator);
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+        max_delta = MAX(max_delta, abs(p_next_element->pulse[i] - p_element->pulse[i]));
+    }
+    // Eased curves change faster than linear for part of the element
+    if (p_element->easing != EASING_LINEAR) max_delta *= EASING_MAX_SLOPE;
+    if (!max_delta) return PATTERN_NO_DEADLINE;
+    return MAX(duration / max_delta, PATTERN_MIN_UPDATE_INTERVAL_us);
+}
+
+void stream_push(uint8_t channel, uint16_t latency, zappy_stream_element_t const *p_elements, uint16_t count,
+                 zappy_stream_status_t *p_status) {
+    stream_t *s = &streams[channel];
+    if (!s->active) {
+        pattern_play(channel, 0);
+        s->tail = s->head;
+        s->anchored = false;
+        s->underruns = 0;
+        // Update flag last in single operation to avoid race conditions.
+        s->active = true;
+    }
+    s->latency = latency * 1000UL;
+    uint16_t head = s->head;
+    uint16_t accepted = MIN(count, STREAM_BUFFER_ELEMENTS - (uint16_t) (head - s->tail));
+    for (uint16_t i = 0; i < accepted; i++) {
+        s->elements[(head + i) & STREAM_INDEX_MASK] = p_elements[i];
+    }
+    // Publish elements in single operation to avoid race conditions.
+    s->head = head + accepted;
+    update_pulses_request();
+
+    uint16_t tail = s->tail;
+    p_status->accepted = accepted;
+    p_status->depth = s->head - tail;
+    p_status->buffered = 0;
+    p_status->underruns = s->underruns;
+    if (s->anchored && p_status->depth) {
+        zappy_stream_element_t const *p_last = stream_element(s, s->head - 1);
+        int32_t buffered = stream_element_time(s, p_last) + p_last->element.duration * 1000UL - us_timestamp();
+        p_status->buffered = MIN(MAX(buffered, 0) / 1000, UINT16_MAX);
+    }
+}
+
+void stream_stop(uint8_t channel) {
+    streams[channel].active = false;
+}
+
+bool stream_active(uint8_t channel) {
+    return streams[channel].active;
+}
+
+uint32_t stream_update(uint8_t channel, uint32_t now) {
+    stream_t *s = &streams[channel];
+    uint16_t head = s->head;
+    uint16_t tail = s->tail;
+    if (head == tail) return PATTERN_NO_DEADLINE;   // Nothing buffered, last output holds
+    zappy_stream_element_t const *p_current = stream_element(s, tail);
+    if (!s->anchored) {
+        // Starting, or restarting after an underrun, so hold back the latency target to refill the buffer.
+        s->anchor_timestamp = p_current->timestamp;
+        s->anchor_time = now + s->latency;
+        s->anchored = true;
+        s->recip = reciprocal(p_current->element.duration * 1000UL);
+    }
+    // Skip to the latest element that has started. Late elements are dropped, rather than played late.
+    bool skipped = false;
+    while ((uint16_t) (head - tail) > 1 && (int32_t) (now - stream_element_time(s, stream_element(s, tail + 1))) >= 0) {
+        tail++;
+        skipped = true;
+    }
+    if (skipped) {
+        p_current = stream_element(s, tail);
+        s->recip = reciprocal(p_current->element.duration * 1000UL);
+        s->tail = tail;
+    }
+    uint32_t start = stream_element_time(s, p_current);
+    if ((int32_t) (now - start) < 0) return start - now;    // Filling up to the latency target
+    zappy_pattern_element_t const *p_element = &p_current->element;
+    uint32_t elapsed = now - start;
+    uint32_t duration = p_element->duration * 1000UL;
+    if ((uint16_t) (head - tail) == 1) {
+        // Transition target hasn't arrived, so hold the element until it does
+        stream_output(channel, p_element, p_element, 0);
+        if (elapsed < duration) return duration - elapsed;
+        // Underrun, the next element to arrive restarts playback
+        s->underruns++;
+        s->anchored = false;
+        s->tail = tail + 1;
+        return PATTERN_NO_DEADLINE;
+    }
+    zappy_stream_element_t const *p_next = stream_element(s, tail + 1);
+    uint32_t wait = stream_element_time(s, p_next) - now;
+    int32_t level = 0;
+    if (p_element->easing != EASING_NONE) {
+        level = EASING_ONE;
+        if (elapsed < duration) {
+            uint16_t completion = recip_scale(elapsed, s->recip.mul, s->recip.shift, 16);
+            level = p_element->easing == EASING_LINEAR ? completion >> 2 : ease(p_element->easing, completion);
+            wait = MIN(wait, duration - elapsed);
+            wait = MIN(wait, stream_step_interval(p_element, &p_next->element, duration));
+        }
+    }
+    stream_output(channel, p_element, &p_next->element, level);
+    return wait;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "serial_protocol.h"
+
+#include "nrfx.h"
+
+#if STREAM_BUFFER_ELEMENTS
+
+/**@brief   Function to add host streamed elements to a channel's buffer.
+ *
+ * The first elements pushed to a channel stop its pattern and start streaming. Elements play from their timestamps,
+ * delayed by the latency target so the buffer absorbs host timing jitter. After an underrun, playback restarts the
+ * latency target after the next element arrives.
+ *
+ * @param[in]  channel      Channel to stream to.
+ * @param[in]  latency      Delay from element timestamp to output, in milliseconds.
+ * @param[in]  p_elements   Elements to buffer, in timestamp order.
+ * @param[in]  count        Number of elements.
+ * @param[out] p_status     Buffer state after elements are added.
+ */
+void stream_push(uint8_t channel, uint16_t latency, zappy_stream_element_t const *p_elements, uint16_t count,
+                 zappy_stream_status_t *p_status);
+
+/// Stops streaming on a channel, discarding buffered elements. The last output is left in place.
+void stream_stop(uint8_t channel);
+
+/// Whether a channel's output comes from streamed elements.
+bool stream_active(uint8_t channel);
+
+/**@brief   Function to play a channel's buffered elements and update its pulse.
+ *
+ * Called by pattern playback in place of a pattern.
+ *
+ * @return  Microseconds until the channel's output next changes, or PATTERN_NO_DEADLINE.
+ */
+uint32_t stream_update(uint8_t channel, uint32_t now);
+
+#endif
+
+#endif //STREAM_H
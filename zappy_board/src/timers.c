@@ -8,12 +8,39 @@
 #include "battery_charger.h"
 #include "board2board_host.h"
 #include "display.h"
+#include "pulse_control.h"
 #include "prv_utils.h"
 #include "prv_timers.h"
+#include "rtc_time.h"
+
+#include "app_timer.h"
+#include "app_util_platform.h"
+
+#if PATTERN_TIMER_SCHEDULING
+APP_TIMER_DEF(pattern_timer);
+static bool pattern_timer_initialized = false;
+
+static void pattern_timer_handler(void __unused *p_context) {
+    uint32_t next_update = update_pulses();
+    if (next_update != PATTERN_NO_DEADLINE) {
+        pattern_timer_start(next_update);
+    }
+}
+#endif
 
 static void update_timer_handler(void __unused *p_context) {
     static uint32_t volatile update_counter = 0;
+    // Keeps the microsecond time base extended across RTC counter overflows
+    us_timestamp();
+    #if !PATTERN_DEADLINE_SCHEDULING && !PATTERN_INTERPOLATE_PER_PULSE
     update_pulses();
+    #endif
+    #if POWER_RAMPING
+    power_ramp_update();
+    #endif
+    #if CHARGE_LIMITER
+    charge_limit_update();
+    #endif
     if (update_counter % (UPDATE_TIMER_FREQ_Hz / BUTTON_SCAN_UPDATE_FREQ_Hz) == 0) {
         button_scan();
     }
@@ -21,6 +48,9 @@ static void update_timer_handler(void __unused *p_context) {
         app_sched_event_put(NULL, 0, SCHED_FN(battery_charger_update));
     }
     if (update_counter % (UPDATE_TIMER_FREQ_Hz / DISPLAY_STATE_UPDATE_FREQ_Hz) == 0) {
+        #if PATTERN_DEADLINE_SCHEDULING || PATTERN_INTERPOLATE_PER_PULSE
+        refresh_pattern_progress();
+        #endif
         update_pattern_progress();
         update_intensities();
     }
@@ -29,12 +59,46 @@ static void update_timer_handler(void __unused *p_context) {
     if (update_counter % (UPDATE_TIMER_FREQ_Hz / BOARD_2_BOARD_POLL_FREQ_Hz) == 0) {
         app_sched_event_put(NULL, 0, SCHED_FN(board2board_host_send));
     }
+    #ifdef DEBUG
+    if (update_counter % (UPDATE_TIMER_FREQ_Hz / CYCLE_COUNT_LOG_FREQ_Hz) == 0) {
+        app_sched_event_put(NULL, 0, SCHED_FN(pulse_cycles_log));
+        app_sched_event_put(NULL, 0, SCHED_FN(patterns_cycles_log));
+    }
+    #endif
 
     update_counter++;
 }
 
 uint32_t inline ms_timestamp(void) { return prv_timestamp(); }
 
+uint32_t us_timestamp(void) {
+    // The 24-bit RTC counter overflows after 512 s, which update_timer_handler calls well within.
+    static rtc_time_t rtc_time = {0};
+    uint32_t timestamp;
+    CRITICAL_REGION_ENTER();
+    timestamp = rtc_ticks_us(rtc_time_update(&rtc_time, app_timer_cnt_get()), APP_TIMER_CONFIG_RTC_FREQUENCY);
+    CRITICAL_REGION_EXIT();
+    return timestamp;
+}
+
+void pattern_timer_start(uint32_t timeout_us) {
+    #if PATTERN_TIMER_SCHEDULING
+    // Patterns may start before timers_init, which requests an update itself.
+    if (!pattern_timer_initialized) return;
+    // Keep well within the 24-bit RTC counter range. Waking early just re-arms the timer.
+    timeout_us = MIN(timeout_us, 60 * 1000 * 1000);
+    // Round up, so the timer doesn't fire just before a deadline.
+    uint32_t ticks = rtc_us_ticks(timeout_us, APP_TIMER_CONFIG_RTC_FREQUENCY);
+    APP_ERROR_CHECK(app_timer_stop(pattern_timer));
+    APP_ERROR_CHECK(app_timer_start(pattern_timer, MAX(ticks, APP_TIMER_MIN_TIMEOUT_TICKS), NULL));
+    #endif
+}
+
 void timers_init(void) {
     prv_timers_init((1000/UPDATE_TIMER_FREQ_Hz), update_timer_handler);
+    #if PATTERN_TIMER_SCHEDULING
+    APP_ERROR_CHECK(app_timer_create(&pattern_timer, APP_TIMER_MODE_SINGLE_SHOT, pattern_timer_handler));
+    pattern_timer_initialized = true;
+    update_pulses_request();
+    #endif
 }
@@ -12,9 +12,19 @@
 #define DISPLAY_STATE_UPDATE_FREQ_Hz 30
 #define BATTERY_CHARGER_UPDATE_FREQ_Hz 1
 #define BOARD_2_BOARD_POLL_FREQ_Hz 50
+#define CYCLE_COUNT_LOG_FREQ_Hz 1
 
 uint32_t ms_timestamp(void);
 
+/**@brief   Function to get a microsecond timestamp, derived from the app_timer RTC.
+ *
+ * Wraps every 2^32 microseconds (~71 minutes), so only compare timestamps by unsigned subtraction.
+ */
+uint32_t us_timestamp(void);
+
+/// Arms the single-shot pattern engine timer, used with PATTERN_DEADLINE_SCHEDULING.
+void pattern_timer_start(uint32_t timeout_us);
+
 void timers_init(void);
 
 #endif //TIMERS_H
@@ -0,0 +1,45 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <stdint.h>
+
+/* Slot indexes of a triple buffer, so a writer and a reader that preempt each other never wait or share a slot.
+ * The writer fills its write slot, the reader uses its read slot, and the middle slot holds the latest complete
+ * write between them. Slots only change hands by atomic exchange with the middle, which compiles to an LDREXB/STREXB
+ * loop, so a writer interrupted at any point never leaves the reader a partly written slot.
+ */
+typedef struct {
+    uint8_t write;              /**< Only used by the writer. */
+    uint8_t volatile middle;    /**< Or'd with TRIPLE_BUFFER_FRESH until the reader takes it. */
+    uint8_t read;               /**< Only used by the reader. */
+} triple_buffer_t;
+
+#define TRIPLE_BUFFER_INIT {.write = 0, .middle = 1, .read = 2}
+
+// Set on the middle slot index when it holds a write the reader hasn't taken yet
+#define TRIPLE_BUFFER_FRESH 0x80
+
+/**@brief   Publishes the write slot as the latest, and takes the middle slot to write next.
+ *
+ * @return  Slot published, which isn't written again until a later publish hands it back.
+ */
+static inline uint8_t triple_buffer_publish(triple_buffer_t *p_buffer) {
+    uint8_t written = p_buffer->write;
+    uint8_t middle = __atomic_exchange_n(&p_buffer->middle, written | TRIPLE_BUFFER_FRESH, __ATOMIC_ACQ_REL);
+    p_buffer->write = middle & ~TRIPLE_BUFFER_FRESH;
+    return written;
+}
+
+/**@brief   Takes the latest published slot, if there's one the reader hasn't seen.
+ *
+ * @return  Read slot.
+ */
+static inline uint8_t triple_buffer_take(triple_buffer_t *p_buffer) {
+    if (p_buffer->middle & TRIPLE_BUFFER_FRESH) {
+        uint8_t middle = __atomic_exchange_n(&p_buffer->middle, p_buffer->read, __ATOMIC_ACQ_REL);
+        p_buffer->read = middle & ~TRIPLE_BUFFER_FRESH;
+    }
+    return p_buffer->read;
+}
+
+#endif //TRIPLE_BUFFER_H
@@ -0,0 +1 @@
+// Host stand-in, app_config.h only needs the SDK configuration on target.
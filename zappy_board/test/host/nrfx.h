@@ -0,0 +1,61 @@
+#ifndef HOST_NRFX_H
+#define HOST_NRFX_H
+
+// Host stand-in for the parts of nrfx the tested modules use.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t nrfx_err_t;
+enum {
+    NRFX_SUCCESS = 0x0BAD0000,
+    NRFX_ERROR_INTERNAL,
+    NRFX_ERROR_NO_MEM,
+    NRFX_ERROR_NOT_SUPPORTED,
+    NRFX_ERROR_INVALID_PARAM,
+    NRFX_ERROR_INVALID_STATE,
+    NRFX_ERROR_INVALID_LENGTH,
+    NRFX_ERROR_TIMEOUT,
+    NRFX_ERROR_FORBIDDEN,
+    NRFX_ERROR_NULL,
+    NRFX_ERROR_INVALID_ADDR,
+    NRFX_ERROR_BUSY,
+    NRFX_ERROR_ALREADY_INITIALIZED,
+};
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+/*
+ * Host stand-ins for the CMSIS SIMD intrinsics, following the Armv7-M ARM. Built with __ARM_FEATURE_DSP defined,
+ * modules take their DSP paths on a host against these.
+ */
+
+/// APSR.GE flags, one per byte.
+static uint32_t host_apsr_ge;
+
+static inline uint32_t __UADD16(uint32_t op1, uint32_t op2) {
+    uint32_t lo = (op1 & 0xFFFF) + (op2 & 0xFFFF);
+    uint32_t hi = (op1 >> 16) + (op2 >> 16);
+    host_apsr_ge = (lo > 0xFFFF ? 0x3 : 0) | (hi > 0xFFFF ? 0xC : 0);
+    return (lo & 0xFFFF) | (hi << 16);
+}
+
+static inline uint32_t __SEL(uint32_t op1, uint32_t op2) {
+    uint32_t result = 0;
+    for (uint8_t byte = 0; byte < 4; byte++) {
+        uint32_t mask = 0xFFUL << (8 * byte);
+        result |= (host_apsr_ge >> byte & 1 ? op1 : op2) & mask;
+    }
+    return result;
+}
+
+#define __PKHBT(op1, op2, shift) (((uint32_t) (op1) & 0x0000FFFF) | (((uint32_t) (op2) << (shift)) & 0xFFFF0000))
+#define __PKHTB(op1, op2, shift) (((uint32_t) (op1) & 0xFFFF0000) | (((uint32_t) (op2) >> (shift)) & 0x0000FFFF))
+
+#endif //HOST_NRFX_H
@@ -0,0 +1,18 @@
+#ifndef HOST_PRV_UTILS_H
+#define HOST_PRV_UTILS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "nrfx.h"
+
+#define __unused __attribute__((unused))
+#define ROUNDED_DIV(a, b) (((a) + ((b) / 2)) / (b))
+#define CEIL_DIV(a, b) ((((a) - 1) / (b)) + 1)
+#define APP_ERROR_CHECK(err_code) ((void) (err_code))
+
+typedef void (*app_sched_event_handler_t)(void *p_event_data, uint16_t event_size);
+#define SCHED_FN(fn) ((app_sched_event_handler_t) (fn))
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size, app_sched_event_handler_t handler);
+
+#endif //HOST_PRV_UTILS_H
@@ -0,0 +1,143 @@
+#include <math.h>
+#include <time.h>
+
+#include "easing.h"
+#include "unit_test.h"
+
+/*
+ * Reference curves from https://easings.net, written out independently of the table generator in easing.c.
+ *
+ * ease() linearly interpolates 129 samples, h = 1/128 apart, so its error in Q14 LSBs is bounded by:
+ *  - 0.5 for rounding samples, plus 1 for flooring the interpolated step,
+ *  - EASING_ONE * h^2 / 8 * max|f''| = max|f''| / 8 for interpolating a smooth curve,
+ *  - the jump of curves defined discontinuously at an end (elastic's, up to 2^-11),
+ *  - EASING_ONE * h / 4 * |change of f'| for bounce's kinks between samples, 5.5 + 2.75 at x = 1 / 2.75.
+ */
+#define LSB_ROUNDING 1.5
+#define CURVE_LSB(max_f2) ((max_f2) / 8.0)
+#define KINK_LSB(slope_change) (EASING_ONE * (slope_change) / (4.0 * 128))
+
+typedef struct {
+    char const *name;
+    double (*f)(double x);
+    double tolerance;   /**< Q14 LSBs */
+} curve_t;
+
+static double sine_in(double x) { return 1 - cos(x * M_PI / 2); }
+static double sine_out(double x) { return sin(x * M_PI / 2); }
+static double sine_in_out(double x) { return -(cos(M_PI * x) - 1) / 2; }
+static double cubic_in(double x) { return x * x * x; }
+static double cubic_out(double x) { return 1 - pow(1 - x, 3); }
+static double cubic_in_out(double x) { return x < 0.5 ? 4 * x * x * x : 1 - pow(-2 * x + 2, 3) / 2; }
+static double elastic_in(double x) {
+    if (x == 0 || x == 1) return x;
+    return -pow(2, 10 * x - 10) * sin((x * 10 - 10.75) * (2 * M_PI / 3));
+}
+static double elastic_out(double x) {
+    if (x == 0 || x == 1) return x;
+    return pow(2, -10 * x) * sin((x * 10 - 0.75) * (2 * M_PI / 3)) + 1;
+}
+static double elastic_in_out(double x) {
+    if (x == 0 || x == 1) return x;
+    double s = sin((20 * x - 11.125) * (2 * M_PI / 4.5));
+    return x < 0.5 ? -pow(2, 20 * x - 10) * s / 2 : pow(2, -20 * x + 10) * s / 2 + 1;
+}
+static double bounce_out(double x) {
+    double const n1 = 7.5625, d1 = 2.75;
+    if (x < 1 / d1) return n1 * x * x;
+    if (x < 2 / d1) return n1 * (x - 1.5 / d1) * (x - 1.5 / d1) + 0.75;
+    if (x < 2.5 / d1) return n1 * (x - 2.25 / d1) * (x - 2.25 / d1) + 0.9375;
+    return n1 * (x - 2.625 / d1) * (x - 2.625 / d1) + 0.984375;
+}
+static double bounce_in(double x) { return 1 - bounce_out(1 - x); }
+static double bounce_in_out(double x) {
+    return x < 0.5 ? (1 - bounce_out(1 - 2 * x)) / 2 : (1 + bounce_out(2 * x - 1)) / 2;
+}
+
+#define LN2 0.69314718055994531
+#define ELASTIC_F2 (100 * LN2 * LN2 + (20 * M_PI / 3) * (20 * M_PI / 3))
+#define ELASTIC_IN_OUT_F2 ((400 * LN2 * LN2 + (40 * M_PI / 4.5) * (40 * M_PI / 4.5)) / 2)
+
+/// Indexed by easing_function_t, reserved functions have no curve.
+static curve_t const curves[EASING_NONE] = {
+    [EASING_SINE_IN]        = {"sine in", sine_in, LSB_ROUNDING + CURVE_LSB(M_PI * M_PI / 4)},
+    [EASING_SINE_OUT]       = {"sine out", sine_out, LSB_ROUNDING + CURVE_LSB(M_PI * M_PI / 4)},
+    [EASING_SINE_IN_OUT]    = {"sine in out", sine_in_out, LSB_ROUNDING + CURVE_LSB(M_PI * M_PI / 2)},
+    [EASING_CUBIC_IN]       = {"cubic in", cubic_in, LSB_ROUNDING + CURVE_LSB(6)},
+    [EASING_CUBIC_OUT]      = {"cubic out", cubic_out, LSB_ROUNDING + CURVE_LSB(6)},
+    [EASING_CUBIC_IN_OUT]   = {"cubic in out", cubic_in_out, LSB_ROUNDING + CURVE_LSB(12)},
+    [EASING_ELASTIC_IN]     = {"elastic in", elastic_in, LSB_ROUNDING + CURVE_LSB(ELASTIC_F2)
+                                                         + EASING_ONE / 2048.0},
+    [EASING_ELASTIC_OUT]    = {"elastic out", elastic_out, LSB_ROUNDING + CURVE_LSB(ELASTIC_F2)
+                                                           + EASING_ONE / 2048.0},
+    [EASING_ELASTIC_IN_OUT] = {"elastic in out", elastic_in_out, LSB_ROUNDING + CURVE_LSB(ELASTIC_IN_OUT_F2)
+                                                                 + EASING_ONE / 2048.0},
+    [EASING_BOUNCE_IN]      = {"bounce in", bounce_in, LSB_ROUNDING + CURVE_LSB(2 * 7.5625)
+                                                       + KINK_LSB(5.5 + 2.75)},
+    [EASING_BOUNCE_OUT]     = {"bounce out", bounce_out, LSB_ROUNDING + CURVE_LSB(2 * 7.5625)
+                                                       + KINK_LSB(5.5 + 2.75)},
+    [EASING_BOUNCE_IN_OUT]  = {"bounce in out", bounce_in_out, LSB_ROUNDING + CURVE_LSB(4 * 7.5625)
+                                                             + KINK_LSB(5.5 + 2.75)},
+};
+
+/// Every completion value of every table against its reference curve.
+static void test_tables(void) {
+    for (easing_function_t easing = EASING_SINE_IN; easing <= EASING_BOUNCE_IN_OUT; easing++) {
+        curve_t const *curve = &curves[easing];
+        double max_error = 0;
+        for (uint32_t completion = 0; completion <= UINT16_MAX; completion++) {
+            double expected = curve->f(completion / 65536.0) * EASING_ONE;
+            double error = fabs(ease(easing, completion) - expected);
+            if (error > max_error) max_error = error;
+        }
+        printf("%-14s max error %6.2f LSB, tolerance %6.2f LSB\n", curve->name, max_error, curve->tolerance);
+        CHECK(max_error <= curve->tolerance, "%s: max error %.2f LSB > %.2f LSB", curve->name, max_error,
+              curve->tolerance);
+        CHECK(ease(easing, 0) == 0, "%s: ease(0) = %d", curve->name, ease(easing, 0));
+    }
+}
+
+static void test_untabled(void) {
+    for (uint32_t completion = 0; completion <= UINT16_MAX; completion++) {
+        CHECK(ease(EASING_LINEAR, completion) == (int32_t) (completion >> 2), "linear: ease(%u) = %d", completion,
+              ease(EASING_LINEAR, completion));
+        CHECK(ease(EASING_NONE, completion) == 0, "none: ease(%u) = %d", completion, ease(EASING_NONE, completion));
+        for (easing_function_t easing = EASING_BOUNCE_IN_OUT + 1; easing < EASING_NONE; easing++) {
+            CHECK(ease(easing, completion) == ease(EASING_LINEAR, completion), "reserved %u: ease(%u) = %d", easing,
+                  completion, ease(easing, completion));
+        }
+        if (unit_test_failures) return;
+    }
+}
+
+/// Host timings only. The Cortex-M4F has a single precision FPU, so doubles are far slower on target.
+static void benchmark(void) {
+    uint32_t const rounds = 200;
+    volatile int64_t sink = 0;
+    clock_t start = clock();
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (uint32_t completion = 0; completion <= UINT16_MAX; completion += 7) {
+            sink += ease((easing_function_t) (EASING_SINE_IN + completion % EASING_BOUNCE_IN_OUT), completion);
+        }
+    }
+    double table_ns = (double) (clock() - start) / CLOCKS_PER_SEC * 1e9;
+    start = clock();
+    volatile double fsink = 0;
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (uint32_t completion = 0; completion <= UINT16_MAX; completion += 7) {
+            fsink += curves[EASING_SINE_IN + completion % EASING_BOUNCE_IN_OUT].f(completion / 65536.0) * EASING_ONE;
+        }
+    }
+    double libm_ns = (double) (clock() - start) / CLOCKS_PER_SEC * 1e9;
+    double calls = rounds * (UINT16_MAX / 7 + 1.0);
+    printf("host: ease() %.2f ns/call, libm double %.2f ns/call\n", table_ns / calls, libm_ns / calls);
+    (void) sink;
+    (void) fsink;
+}
+
+int main(void) {
+    test_tables();
+    test_untabled();
+    benchmark();
+    return UNIT_TEST_RESULT();
+}
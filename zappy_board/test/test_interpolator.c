@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "interpolator.h"
+#include "unit_test.h"
+
+// interpolator.c built with __ARM_FEATURE_DSP, see CMakeLists.txt
+void dsp_interp_seed(uint8_t channel, uint8_t lane, uint32_t value, uint32_t step);
+void dsp_interp_advance(uint8_t channel, uint32_t steps);
+void dsp_interp_output(uint8_t channel, zappy_pulse_t pulse, uint16_t *p_power_modulator);
+
+/// Exact 16.16 lanes, wrapping modulo 2^32 as the kernels do.
+static struct {
+    uint32_t values[INTERP_LANES];
+    uint32_t steps[INTERP_LANES];
+} reference[DEVICE_CHANNEL_COUNT];
+
+static uint32_t random_u32(void) {
+    return (uint32_t) rand() << 17 ^ (uint32_t) rand() << 2 ^ (uint32_t) rand();
+}
+
+/// Values & steps that exercise fractional carries & borrows, as well as arbitrary ones.
+static uint32_t random_fixed(void) {
+    switch (rand() % 5) {
+        case 0: return random_u32() | 0xFFFF;
+        case 1: return random_u32() & 0xFFFF0000;
+        case 2: return (uint32_t) -(int32_t) (random_u32() & 0x3FFFF);
+        case 3: return random_u32() & 0x3FFFF;
+        default: return random_u32();
+    }
+}
+
+static void seed(uint8_t channel, uint8_t lane, uint32_t value, uint32_t step) {
+    interp_seed(channel, lane, value, step);
+    dsp_interp_seed(channel, lane, value, step);
+    reference[channel].values[lane] = value;
+    reference[channel].steps[lane] = step;
+}
+
+static void advance(uint8_t channel, uint32_t steps) {
+    interp_advance(channel, steps);
+    dsp_interp_advance(channel, steps);
+    for (uint8_t lane = 0; lane < INTERP_LANES; lane++) {
+        reference[channel].values[lane] += reference[channel].steps[lane] * steps;
+    }
+}
+
+static void check_outputs(uint8_t channel, char const *context) {
+    zappy_pulse_t portable, dsp;
+    uint16_t portable_modulator, dsp_modulator;
+    interp_output(channel, portable, &portable_modulator);
+    dsp_interp_output(channel, dsp, &dsp_modulator);
+    for (uint8_t lane = 0; lane < INTERP_LANES; lane++) {
+        uint16_t expected = reference[channel].values[lane] >> 16;
+        uint16_t p = lane == INTERP_POWER_MODULATOR_LANE ? portable_modulator : portable[lane];
+        uint16_t d = lane == INTERP_POWER_MODULATOR_LANE ? dsp_modulator : dsp[lane];
+        CHECK(p == expected, "%s: channel %u lane %u portable 0x%04x, expected 0x%04x", context, channel, lane, p,
+              expected);
+        CHECK(d == expected, "%s: channel %u lane %u DSP 0x%04x, expected 0x%04x", context, channel, lane, d,
+              expected);
+    }
+}
+
+static void test_carries(void) {
+    // Fractional carry into the integer half, on both halves of a pair, without crossing between them
+    seed(0, 0, 0x0000FFFF, 0x00000001);
+    seed(0, 1, 0xFFFFFFFF, 0x00000001);
+    seed(0, 2, 0x12348000, 0x00008000);
+    seed(0, 3, 0x00010000, 0xFFFFFFFF);
+    seed(0, INTERP_POWER_MODULATOR_LANE, 0x0FFF0000, 0xFFFF0000);
+    check_outputs(0, "seeded");
+    advance(0, 1);
+    check_outputs(0, "1 step");
+    advance(0, 0);
+    check_outputs(0, "0 steps");
+    advance(0, 3);
+    check_outputs(0, "3 steps");
+    advance(0, 0x10001);
+    check_outputs(0, "0x10001 steps");
+}
+
+static void test_random(void) {
+    srand(1);
+    for (uint32_t iteration = 0; iteration < 100000 && unit_test_failures < 20; iteration++) {
+        uint8_t channel = rand() % DEVICE_CHANNEL_COUNT;
+        for (uint8_t lane = 0; lane < INTERP_LANES; lane++) seed(channel, lane, random_fixed(), random_fixed());
+        for (uint8_t i = 0; i < 8; i++) {
+            // Mostly single steps, as between pulses, & catching up after missed updates
+            uint32_t steps = rand() % 3 ? 1 : rand() % 4 ? (uint32_t) rand() % 1000 : random_u32();
+            advance(channel, steps);
+            check_outputs(channel, "random");
+        }
+        // Seeding & advancing one channel leaves the others
+        for (uint8_t other = 0; other < DEVICE_CHANNEL_COUNT; other++) check_outputs(other, "other channels");
+    }
+}
+
+/*
+ * Both kernels timed over the same loop. On host the DSP kernel runs against emulated intrinsics, so only its relative
+ * cost on target means anything. Built for target, with the main interpolator.c built with INTERP_PORTABLE, the loop
+ * counts core cycles with the DWT cycle counter instead, kept under its 2^32 wrap by fewer rounds.
+ */
+#ifdef __arm__
+#include "nrf.h"
+#define BENCHMARK_ROUNDS (100 * 1000)
+#define BENCHMARK_UNIT "cycles"
+static uint32_t benchmark_start;
+
+static void benchmark_begin(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    benchmark_start = DWT->CYCCNT;
+}
+
+static double benchmark_elapsed(void) {
+    return DWT->CYCCNT - benchmark_start;
+}
+#else
+#define BENCHMARK_ROUNDS (10 * 1000 * 1000)
+#define BENCHMARK_UNIT "ns"
+static struct timespec benchmark_start;
+
+static void benchmark_begin(void) {
+    clock_gettime(CLOCK_MONOTONIC, &benchmark_start);
+}
+
+static double benchmark_elapsed(void) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - benchmark_start.tv_sec) * 1e9 + (end.tv_nsec - benchmark_start.tv_nsec);
+}
+#endif
+
+/// Single steps & outputs, round robin over the channels, as between pulses.
+static void benchmark_kernel(char const *name, void (*advance_fn)(uint8_t, uint32_t),
+                             void (*output_fn)(uint8_t, zappy_pulse_t, uint16_t *)) {
+    zappy_pulse_t pulse;
+    uint16_t modulator;
+    benchmark_begin();
+    for (uint32_t round = 0; round < BENCHMARK_ROUNDS; round++) {
+        advance_fn(round % DEVICE_CHANNEL_COUNT, 1);
+        output_fn(round % DEVICE_CHANNEL_COUNT, pulse, &modulator);
+    }
+    double elapsed = benchmark_elapsed();
+    printf("%-8s interp_advance + interp_output %.2f " BENCHMARK_UNIT "/call (0x%04x)\n", name,
+           elapsed / BENCHMARK_ROUNDS, pulse[0]);
+}
+
+static void benchmark(void) {
+    benchmark_kernel("portable", interp_advance, interp_output);
+    benchmark_kernel("DSP", dsp_interp_advance, dsp_interp_output);
+}
+
+int main(void) {
+    test_carries();
+    test_random();
+    benchmark();
+    return UNIT_TEST_RESULT();
+}
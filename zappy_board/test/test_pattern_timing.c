@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pattern_control.h"
+#include "pulse_control.h"
+#include "display.h"
+#include "playlist.h"
+#include "prv_utils.h"
+#include "rtc_time.h"
+#include "storage.h"
+#include "stream.h"
+#include "timers.h"
+#include "unit_test.h"
+
+/*
+ * Plays a pattern through pattern_control.c for 10 minutes of simulated RTC time, with the pattern timer firing late
+ * by random update latency, and checks element boundaries keep to the pattern's summed durations.
+ */
+
+#define RTC_FREQUENCY_Hz 32768ULL
+#define SECONDS(s) ((uint64_t) (s) * RTC_FREQUENCY_Hz)
+#define MAX_LATENCY_us 3000
+
+/// Simulated RTC ticks since boot, & us_timestamp's view of them.
+static uint64_t rtc_ticks;
+static rtc_time_t rtc_time;
+
+uint32_t us_timestamp(void) { return rtc_ticks_us(rtc_time_update(&rtc_time, rtc_ticks & RTC_COUNTER_MASK), 0); }
+uint32_t ms_timestamp(void) { return us_timestamp() / 1000; }
+
+/* Fakes of the modules pattern_control.c drives */
+
+uint8_t volatile channels_active = 0x1;
+static uint32_t pulses_set;
+
+bool set_pulse(uint8_t __unused channel, zappy_pulse_t const __unused p_pulse, uint16_t __unused power_mod) {
+    pulses_set++;
+    return true;
+}
+uint8_t max_pulse_index(uint8_t __unused channel) { return PULSE_EDGES - 1; }
+uint16_t min_pulse_ticks(uint8_t __unused channel) { return MIN_PULSE_VALUE; }
+pulse_resolution_t pulse_resolution(uint8_t __unused channel) { return PULSE_RESOLUTION_1_US; }
+void set_pulse_resolution(uint8_t __unused channel, pulse_resolution_t __unused resolution) {}
+void set_pulse_burst(uint8_t __unused channel, uint16_t __unused count, uint16_t __unused spacing) {}
+void pattern_timer_start(uint32_t __unused timeout_us) {}
+void update_adjusts(void) {}
+void playlist_pattern_switched(uint8_t __unused *p_channel) {}
+bool stream_active(uint8_t __unused channel) { return false; }
+void stream_stop(uint8_t __unused channel) {}
+uint32_t stream_update(uint8_t __unused channel, uint32_t __unused now) { return PATTERN_NO_DEADLINE; }
+bool next_pattern_index(uint16_t __unused *p_nth, bool __unused reverse) { return false; }
+uint32_t app_sched_event_put(void const __unused *p_event_data, uint16_t __unused event_size,
+                             app_sched_event_handler_t __unused handler) {
+    return 0;
+}
+
+#define ELEMENT_COUNT 3
+static uint16_t const durations_ms[ELEMENT_COUNT] = {1000, 777, 333};
+
+static union {
+    uint8_t bytes[ZAPPY_PATTERN_HEADER_SIZE + ELEMENT_COUNT * sizeof(zappy_pattern_element_t)];
+    zappy_pattern_t pattern;
+} stored;
+
+nrfx_err_t get_nth_pattern(zappy_pattern_t const **p_pattern, uint16_t nth) {
+    if (nth != 1) return NRFX_ERROR_INVALID_ADDR;
+    *p_pattern = &stored.pattern;
+    return NRFX_SUCCESS;
+}
+
+static void store_pattern(void) {
+    pattern_adjust_t adjust = {.algorithm = ADJUST_IGNORED};
+    uint16_t element_count = ELEMENT_COUNT;
+    memcpy(stored.bytes + offsetof(zappy_pattern_t, pattern_adjust), &adjust, sizeof(adjust));
+    memcpy(stored.bytes + offsetof(zappy_pattern_t, element_count), &element_count, sizeof(element_count));
+    static easing_function_t const easings[ELEMENT_COUNT] = {EASING_LINEAR, EASING_NONE, EASING_SINE_IN_OUT};
+    for (uint8_t i = 0; i < ELEMENT_COUNT; i++) {
+        zappy_pattern_element_t element = {
+            .pulse = {MIN_PULSE_VALUE + 100 * i, MIN_PULSE_VALUE + 100 * i + 50, 0, MIN_PULSE_VALUE + 1000},
+            .duration = durations_ms[i],
+            .easing = easings[i],
+        };
+        memcpy(stored.bytes + offsetof(zappy_pattern_t, elements) + i * sizeof(element), &element, sizeof(element));
+    }
+}
+
+/// Plays for duration from start_ticks, the pattern timer firing up to MAX_LATENCY_us after each deadline.
+static void check_playback(uint64_t start_ticks, uint64_t duration, char const *name) {
+    rtc_ticks = start_ticks;
+    rtc_time = (rtc_time_t) {.ticks = start_ticks, .last_count = start_ticks & RTC_COUNTER_MASK};
+    CHECK(pattern_play(0, 1) == NRFX_SUCCESS, "%s: pattern didn't play", name);
+    uint32_t scheduled = pattern_playback[0].element_start;
+    uint16_t index = pattern_playback[0].element_index;
+    uint32_t transitions = 0, max_lateness = 0, max_boundary_error = 0;
+    uint64_t pass_us = 0;
+    for (uint8_t i = 0; i < ELEMENT_COUNT; i++) pass_us += durations_ms[i] * 1000UL;
+
+    while (rtc_ticks - start_ticks < duration && unit_test_failures < 10) {
+        uint32_t wait = update_pulses();
+        uint32_t now = us_timestamp();
+        if (pattern_playback[0].element_index != index) {
+            // Element boundaries follow from the schedule, however late updates noticed them
+            scheduled += durations_ms[index] * 1000UL;
+            index = pattern_playback[0].element_index;
+            transitions++;
+            uint32_t error = (uint32_t) abs((int32_t) (pattern_playback[0].element_start - scheduled));
+            if (error > max_boundary_error) max_boundary_error = error;
+            uint32_t lateness = now - scheduled;
+            if (lateness > max_lateness) max_lateness = lateness;
+        }
+        CHECK(wait != PATTERN_NO_DEADLINE, "%s: no deadline while playing", name);
+        // As pattern_timer_start arms the RTC, plus latency
+        rtc_ticks += MAX(rtc_us_ticks(wait, 0), 1) + rtc_us_ticks(rand() % MAX_LATENCY_us, 0);
+    }
+    uint64_t expected = (duration * 1000000 / RTC_FREQUENCY_Hz) / pass_us * ELEMENT_COUNT;
+    CHECK(pulses_set, "%s: no pulses set", name);
+    printf("%s: %u transitions, max boundary error %u us, max lateness %u us\n", name, transitions,
+           max_boundary_error, max_lateness);
+    CHECK(max_boundary_error == 0, "%s: element boundaries drifted %u us", name, max_boundary_error);
+    CHECK(transitions >= expected && transitions <= expected + ELEMENT_COUNT, "%s: %u transitions, expected %llu",
+          name, transitions, (unsigned long long) expected);
+    // Updates come no later than latency after a deadline, plus rounding up to whole RTC ticks
+    CHECK(max_lateness <= MAX_LATENCY_us + 2 * 31, "%s: element switched %u us late", name, max_lateness);
+}
+
+int main(void) {
+    srand(1);
+    store_pattern();
+    // Crossing the 24-bit RTC counter overflow at 512 s
+    check_playback(SECONDS(100) + 3, SECONDS(600), "10 minutes");
+    // Crossing the 2^32 us timestamp wrap as well
+    uint64_t wrap_ticks = ((1ULL << 32) << RTC_TICK_US_SHIFT) / RTC_TICK_US_NUM(0);
+    check_playback(wrap_ticks - SECONDS(300) + 11, SECONDS(600), "10 minutes across the 2^32 us wrap");
+    return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pwm_sequence.h"
+#include "unit_test.h"
+
+#define CAPACITY 64
+#define MAX_SEGMENTS 256
+
+/// A run of constant gate levels.
+typedef struct {
+    bool gates[2];
+    uint32_t ticks;
+} segment_t;
+
+typedef struct {
+    segment_t segments[MAX_SEGMENTS];
+    uint16_t count;
+} timeline_t;
+
+static void timeline_append(timeline_t *t, bool const gates[2], uint32_t ticks) {
+    if (!ticks) return;
+    if (t->count && t->segments[t->count - 1].gates[0] == gates[0] && t->segments[t->count - 1].gates[1] == gates[1]) {
+        t->segments[t->count - 1].ticks += ticks;
+        return;
+    }
+    t->segments[t->count++] = (segment_t) {.gates = {gates[0], gates[1]}, .ticks = ticks};
+}
+
+/// Gate levels over time as the pulse timers play a pulse: each edge toggles its gate, the last edge ends the period.
+static void model_timeline(timeline_t *t, zappy_pulse_t const pulse, uint8_t burst_count, uint16_t burst_spacing,
+                           uint8_t tick_shift) {
+    bool gates[2] = {false, false};
+    memset(t, 0, sizeof(*t));
+    uint16_t period = 0;
+    for (uint8_t i = 0; i < PULSE_EDGES; i++) if (pulse[i] > period) period = pulse[i];
+    if (!period) {
+        timeline_append(t, gates, PWM_TOP_MAX);
+        return;
+    }
+    if (burst_count < 1) burst_count = 1;
+    for (uint8_t repeat = 0; repeat < 2; repeat++) {
+        uint32_t position = 0;
+        for (uint32_t tick = 1; tick <= period; tick++) {
+            bool toggled = false;
+            for (uint8_t sub_pulse = 0; sub_pulse < burst_count; sub_pulse++) {
+                for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+                    if (pulse[i] && pulse[i] - sub_pulse * burst_spacing == (int32_t) tick) {
+                        if (!toggled) timeline_append(t, gates, (tick - position) << tick_shift);
+                        position = tick;
+                        toggled = true;
+                        gates[i / 2] = !gates[i / 2];
+                    }
+                }
+            }
+        }
+        if (!gates[0] && !gates[1]) return;
+    }
+    CHECK(false, "gates still toggled after two periods");
+}
+
+/// Gate levels over time as the PWM peripheral plays a sequence, checking every wave is one it can play.
+static void render_timeline(timeline_t *t, pwm_wave_t const *p_waves, uint16_t count) {
+    memset(t, 0, sizeof(*t));
+    for (uint16_t i = 0; i < count; i++) {
+        pwm_wave_t const *w = &p_waves[i];
+        for (uint8_t g = 0; g < 2; g++) {
+            CHECK(w->gates[g] == PWM_GATE_ON || w->gates[g] == PWM_GATE_OFF, "wave %u gate %u = 0x%04x", i, g,
+                  w->gates[g]);
+        }
+        CHECK(w->unused == PWM_GATE_OFF, "wave %u unused output = 0x%04x", i, w->unused);
+        CHECK(w->top >= PWM_TOP_MIN && w->top <= PWM_TOP_MAX, "wave %u top = %u", i, w->top);
+        if (i) {
+            // Equal neighbours are only left by splitting a run longer than PWM_TOP_MAX
+            pwm_wave_t const *prev = &p_waves[i - 1];
+            CHECK(prev->gates[0] != w->gates[0] || prev->gates[1] != w->gates[1]
+                  || (uint32_t) prev->top + w->top > PWM_TOP_MAX, "waves %u & %u should be merged", i - 1, i);
+        }
+        bool gates[2] = {w->gates[0] == PWM_GATE_ON, w->gates[1] == PWM_GATE_ON};
+        timeline_append(t, gates, w->top);
+    }
+}
+
+static void check_timelines_equal(timeline_t const *expected, timeline_t const *actual, char const *name) {
+    CHECK(expected->count == actual->count, "%s: %u segments, expected %u", name, actual->count, expected->count);
+    for (uint16_t i = 0; i < expected->count && i < actual->count; i++) {
+        segment_t const *e = &expected->segments[i], *a = &actual->segments[i];
+        CHECK(e->gates[0] == a->gates[0] && e->gates[1] == a->gates[1] && e->ticks == a->ticks,
+              "%s: segment %u is %d%d x %u, expected %d%d x %u", name, i, a->gates[0], a->gates[1], a->ticks,
+              e->gates[0], e->gates[1], e->ticks);
+    }
+}
+
+#define ON PWM_GATE_ON
+#define OFF PWM_GATE_OFF
+#define WAVE(a, b, t) {.gates = {(a), (b)}, .unused = PWM_GATE_OFF, .top = (t)}
+
+static void check_waves(char const *name, zappy_pulse_t const pulse, uint8_t burst_count, uint16_t burst_spacing,
+                        uint8_t tick_shift, pwm_wave_t const *p_expected, uint16_t expected_count) {
+    pwm_wave_t waves[CAPACITY];
+    uint16_t count = pwm_sequence_build(waves, CAPACITY, pulse, burst_count, burst_spacing, tick_shift);
+    CHECK(count == expected_count, "%s: %u waves, expected %u", name, count, expected_count);
+    for (uint16_t i = 0; i < count && i < expected_count; i++) {
+        CHECK(!memcmp(&waves[i], &p_expected[i], sizeof(pwm_wave_t)),
+              "%s: wave %u is {0x%04x, 0x%04x, %u}, expected {0x%04x, 0x%04x, %u}", name, i, waves[i].gates[0],
+              waves[i].gates[1], waves[i].top, p_expected[i].gates[0], p_expected[i].gates[1], p_expected[i].top);
+    }
+    timeline_t expected, actual;
+    model_timeline(&expected, pulse, burst_count, burst_spacing, tick_shift);
+    render_timeline(&actual, waves, count);
+    check_timelines_equal(&expected, &actual, name);
+}
+
+static void test_gate_levels(void) {
+    // Gates are active high & idle low. A compare value of 0 with polarity bit 15 clear holds the output high.
+    CHECK(PWM_GATE_ON == 0x0000, "PWM_GATE_ON = 0x%04x", PWM_GATE_ON);
+    CHECK(PWM_GATE_OFF == 0x8000, "PWM_GATE_OFF = 0x%04x", PWM_GATE_OFF);
+    CHECK(sizeof(pwm_wave_t) == 4 * sizeof(uint16_t), "pwm_wave_t isn't laid out as nrf_pwm_values_wave_form_t");
+
+    static pwm_wave_t const idle[] = {WAVE(OFF, OFF, PWM_TOP_MAX)};
+    check_waves("no edges", (zappy_pulse_t) {0, 0, 0, 0}, 1, 0, 0, idle, 1);
+
+    static pwm_wave_t const biphasic[] = {
+        WAVE(OFF, OFF, 100), WAVE(ON, OFF, 100), WAVE(OFF, OFF, 100), WAVE(OFF, ON, 6700),
+    };
+    check_waves("biphasic", (zappy_pulse_t) {100, 200, 300, 7000}, 1, 0, 0, biphasic, 4);
+
+    // Edges out of index order still toggle their own gates
+    static pwm_wave_t const reversed[] = {
+        WAVE(OFF, OFF, 100), WAVE(OFF, ON, 100), WAVE(OFF, OFF, 100), WAVE(ON, OFF, 6700),
+    };
+    check_waves("reversed", (zappy_pulse_t) {300, 7000, 100, 200}, 1, 0, 0, reversed, 4);
+
+    static pwm_wave_t const shifted[] = {
+        WAVE(OFF, OFF, 100 << 4), WAVE(ON, OFF, 100 << 4), WAVE(OFF, OFF, 100 << 4), WAVE(OFF, ON, 1700 << 4),
+    };
+    check_waves("tick shift", (zappy_pulse_t) {100, 200, 300, 2000}, 1, 0, 4, shifted, 4);
+}
+
+static void test_split(void) {
+    static pwm_wave_t const exact[] = {WAVE(OFF, OFF, 100), WAVE(ON, OFF, PWM_TOP_MAX)};
+    check_waves("run of PWM_TOP_MAX", (zappy_pulse_t) {100, 100 + PWM_TOP_MAX, 0, 0}, 1, 0, 0, exact, 2);
+
+    // A remainder too short for a PWM period of its own is avoided by halving instead
+    static pwm_wave_t const halved[] = {WAVE(OFF, OFF, 100), WAVE(ON, OFF, 0x4000), WAVE(ON, OFF, 0x4000)};
+    check_waves("run of PWM_TOP_MAX + 1", (zappy_pulse_t) {100, 100 + PWM_TOP_MAX + 1, 0, 0}, 1, 0, 0, halved, 3);
+
+    static pwm_wave_t const long_run[] = {
+        WAVE(OFF, OFF, 100 << 4), WAVE(ON, OFF, PWM_TOP_MAX), WAVE(ON, OFF, 0x4000), WAVE(ON, OFF, 0x4001),
+    };
+    check_waves("run of 0x10000", (zappy_pulse_t) {100, 100 + 0x1000, 0, 0}, 1, 0, 4, long_run, 4);
+
+    static pwm_wave_t const remainder[] = {
+        WAVE(OFF, OFF, 100 << 4), WAVE(ON, OFF, PWM_TOP_MAX), WAVE(ON, OFF, PWM_TOP_MAX), WAVE(ON, OFF, 0x12),
+    };
+    check_waves("run of 0x10010", (zappy_pulse_t) {100, 100 + 0x1001, 0, 0}, 1, 0, 4, remainder, 4);
+
+    // Runs too short are lengthened, which is the only case sequences run long
+    pwm_wave_t waves[CAPACITY];
+    uint16_t count = pwm_sequence_build(waves, CAPACITY, (zappy_pulse_t) {100, 101, 0, 0}, 1, 0, 0);
+    CHECK(count == 2 && waves[1].top == PWM_TOP_MIN, "1 tick run: %u waves, top %u", count, waves[1].top);
+}
+
+static void test_merge(void) {
+    // Coincident edges on one gate cancel out, so the runs either side are one
+    static pwm_wave_t const cancelled[] = {WAVE(OFF, OFF, 300), WAVE(OFF, ON, 100)};
+    check_waves("coincident edges", (zappy_pulse_t) {100, 100, 300, 400}, 1, 0, 0, cancelled, 2);
+
+    // Merging carries on through PWM_TOP_MAX splits
+    static pwm_wave_t const merged_split[] = {
+        WAVE(OFF, OFF, PWM_TOP_MAX), WAVE(OFF, OFF, 0x4000), WAVE(OFF, OFF, 0x4001), WAVE(OFF, ON, 0x100),
+    };
+    check_waves("coincident edges past PWM_TOP_MAX", (zappy_pulse_t) {0x700, 0x700, 0x1000, 0x1010}, 1, 0, 4,
+                merged_split, 4);
+
+    // Edges of both gates together change both levels in one wave
+    static pwm_wave_t const both[] = {WAVE(OFF, OFF, 100), WAVE(ON, ON, 100), WAVE(OFF, ON, 200)};
+    check_waves("both gates", (zappy_pulse_t) {100, 200, 100, 400}, 1, 0, 0, both, 3);
+}
+
+static void test_burst(void) {
+    static pwm_wave_t const burst[] = {
+        WAVE(OFF, OFF, 1100), WAVE(ON, OFF, 100),
+        WAVE(OFF, OFF, 400), WAVE(ON, OFF, 100),
+        WAVE(OFF, OFF, 400), WAVE(ON, OFF, 100),
+    };
+    check_waves("burst of 3", (zappy_pulse_t) {2100, 2200, 0, 0}, 3, 500, 0, burst, 6);
+
+    static pwm_wave_t const biphasic_burst[] = {
+        WAVE(OFF, OFF, 2000), WAVE(ON, OFF, 100), WAVE(OFF, ON, 100), WAVE(OFF, OFF, 800),
+        WAVE(ON, OFF, 100), WAVE(OFF, ON, 100),
+    };
+    check_waves("biphasic burst of 2", (zappy_pulse_t) {3000, 3100, 3100, 3200}, 2, 1000, 0, biphasic_burst, 6);
+
+    // Burst counts of 0 & 1 both play single pulses
+    static pwm_wave_t const single[] = {WAVE(OFF, OFF, 2100), WAVE(ON, OFF, 100)};
+    check_waves("burst of 0", (zappy_pulse_t) {2100, 2200, 0, 0}, 0, 500, 0, single, 2);
+    check_waves("burst of 1", (zappy_pulse_t) {2100, 2200, 0, 0}, 1, 500, 0, single, 2);
+}
+
+static void test_toggled(void) {
+    // Gate A only has one edge, so it's left on & the second period turns it off
+    static pwm_wave_t const toggled[] = {
+        WAVE(OFF, OFF, 100), WAVE(ON, OFF, 200), WAVE(ON, ON, 100),
+        WAVE(ON, OFF, 100), WAVE(OFF, OFF, 200), WAVE(OFF, ON, 100),
+    };
+    check_waves("gate A toggled", (zappy_pulse_t) {100, 0, 300, 400}, 1, 0, 0, toggled, 6);
+
+    // The last edge toggling gate B on leaves it on through the start of the second period
+    static pwm_wave_t const last_edge[] = {
+        WAVE(OFF, OFF, 100), WAVE(ON, OFF, 100), WAVE(OFF, OFF, 200),
+        WAVE(OFF, ON, 100), WAVE(ON, ON, 100), WAVE(OFF, ON, 200),
+    };
+    check_waves("gate B toggled by the last edge", (zappy_pulse_t) {100, 200, 0, 400}, 1, 0, 0, last_edge, 6);
+}
+
+static void test_capacity(void) {
+    pwm_wave_t waves[CAPACITY];
+    zappy_pulse_t const pulse = {2100, 2200, 0, 0};
+    uint16_t needed = pwm_sequence_build(waves, CAPACITY, pulse, 3, 500, 0);
+    CHECK(pwm_sequence_build(waves, needed, pulse, 3, 500, 0) == needed, "exact capacity");
+    CHECK(pwm_sequence_build(waves, needed - 1, pulse, 3, 500, 0) == 0, "short of capacity");
+    CHECK(pwm_sequence_build(waves, 0, pulse, 1, 0, 0) == 0, "no capacity");
+}
+
+/// Random pulses & bursts, with runs long enough that none are lengthened, against the timer model.
+static void test_random(void) {
+    srand(1);
+    for (uint32_t iteration = 0; iteration < 20000; iteration++) {
+        zappy_pulse_t pulse = {0};
+        uint8_t tick_shift = rand() % 5;
+        uint8_t burst_count = 1 + rand() % 4;
+        uint16_t burst_spacing = 0;
+        uint16_t limit = (uint16_t) (0xFFFF >> (tick_shift > 1 ? tick_shift - 1 : 0));
+        for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+            // Disabled edges, ties & spread out edges
+            int kind = rand() % 6;
+            pulse[i] = kind == 0 ? 0 : kind == 1 && i ? pulse[i - 1] : (uint16_t) (2000 + rand() % (limit - 2000));
+        }
+        uint16_t first = UINT16_MAX, last = 0;
+        for (uint8_t i = 0; i < PULSE_EDGES; i++) {
+            if (!pulse[i]) continue;
+            if (pulse[i] < first) first = pulse[i];
+            if (pulse[i] > last) last = pulse[i];
+        }
+        if (last) {
+            // Sub-pulses mustn't overlap, & must start after 0
+            uint16_t width = last - first;
+            uint16_t max_spacing = burst_count > 1 ? (first - 1) / (burst_count - 1) : 0;
+            if (max_spacing <= width + 1) {
+                burst_count = 1;
+            } else {
+                burst_spacing = width + 1 + rand() % (max_spacing - width);
+            }
+        }
+        // Keep every run long enough to play exactly
+        bool exact = true;
+        for (uint8_t a = 0; a < PULSE_EDGES; a++) {
+            for (uint8_t b = 0; b < PULSE_EDGES; b++) {
+                for (uint8_t s = 0; s < burst_count && pulse[a] && pulse[b]; s++) {
+                    int32_t gap = (int32_t) pulse[a] - (pulse[b] - s * burst_spacing);
+                    if (gap && abs(gap) << tick_shift < PWM_TOP_MIN) exact = false;
+                }
+            }
+        }
+        if (!exact) continue;
+
+        pwm_wave_t waves[MAX_SEGMENTS];
+        uint16_t count = pwm_sequence_build(waves, MAX_SEGMENTS, pulse, burst_count, burst_spacing, tick_shift);
+        CHECK(count, "{%u, %u, %u, %u} x %u didn't fit", pulse[0], pulse[1], pulse[2], pulse[3], burst_count);
+        timeline_t expected, actual;
+        model_timeline(&expected, pulse, burst_count, burst_spacing, tick_shift);
+        render_timeline(&actual, waves, count);
+        char name[64];
+        snprintf(name, sizeof(name), "{%u, %u, %u, %u} x %u every %u << %u", pulse[0], pulse[1], pulse[2], pulse[3],
+                 burst_count, burst_spacing, tick_shift);
+        check_timelines_equal(&expected, &actual, name);
+        if (unit_test_failures > 20) return;
+    }
+}
+
+int main(void) {
+    test_gate_levels();
+    test_split();
+    test_merge();
+    test_burst();
+    test_toggled();
+    test_capacity();
+    test_random();
+    return UNIT_TEST_RESULT();
+}
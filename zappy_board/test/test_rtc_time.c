@@ -0,0 +1,107 @@
+#include <stdlib.h>
+
+#include "rtc_time.h"
+#include "unit_test.h"
+
+#define RTC_FREQUENCY_Hz 32768ULL
+#define SECONDS(s) ((uint64_t) (s) * RTC_FREQUENCY_Hz)
+
+static uint64_t random_u64(void) {
+    return (uint64_t) rand() << 42 ^ (uint64_t) rand() << 21 ^ (uint64_t) rand();
+}
+
+/// Exact microseconds of a number of RTC ticks, rounded down.
+static uint64_t exact_us(uint64_t ticks, uint32_t prescaler) {
+    return (uint64_t) ((unsigned __int128) ticks * (prescaler + 1) * 1000000 / RTC_FREQUENCY_Hz);
+}
+
+static void test_counter_overflow(void) {
+    rtc_time_t time = {.ticks = 1000, .last_count = 0xFFFFF0};
+    CHECK(rtc_time_update(&time, 0x000010) == 1000 + 0x20, "ticks = %llu", (unsigned long long) time.ticks);
+    CHECK(rtc_time_update(&time, 0x000010) == 1000 + 0x20, "no ticks counted twice");
+    // One short of a whole overflow is the longest gap between updates
+    CHECK(rtc_time_update(&time, 0x00000F) == 1000 + 0x20 + RTC_COUNTER_MASK, "ticks = %llu",
+          (unsigned long long) time.ticks);
+}
+
+/// Three days of updates, at random gaps up to the counter overflow, against the ticks that actually passed.
+static void test_extension(void) {
+    srand(1);
+    rtc_time_t time = {0};
+    uint64_t ticks = 0;
+    uint32_t updates = 0;
+    while (ticks < SECONDS(3 * 24 * 3600) && unit_test_failures < 10) {
+        ticks += rand() % 4 ? 1 + rand() % SECONDS(1) : 1 + random_u64() % RTC_COUNTER_MASK;
+        uint64_t counted = rtc_time_update(&time, ticks & RTC_COUNTER_MASK);
+        CHECK(counted == ticks, "update %u: counted %llu ticks, expected %llu", updates, (unsigned long long) counted,
+              (unsigned long long) ticks);
+        updates++;
+    }
+}
+
+static void test_conversion(void) {
+    static uint32_t const prescalers[] = {0, 1, 3, 31};
+    srand(2);
+    for (uint8_t p = 0; p < sizeof(prescalers) / sizeof(prescalers[0]); p++) {
+        uint32_t prescaler = prescalers[p];
+        for (uint32_t i = 0; i < 1000000 && unit_test_failures < 10; i++) {
+            // Up to ~17 years of ticks
+            uint64_t ticks = random_u64() & ((1ULL << 44) - 1);
+            uint32_t us = rtc_ticks_us(ticks, prescaler);
+            CHECK(us == (uint32_t) exact_us(ticks, prescaler), "%llu ticks at prescaler %u is %u us, expected %u",
+                  (unsigned long long) ticks, prescaler, us, (uint32_t) exact_us(ticks, prescaler));
+            // Round trips round up, so timers armed from microseconds never fire early
+            uint32_t timeout = (uint32_t) ticks;
+            uint32_t timeout_ticks = rtc_us_ticks(timeout, prescaler);
+            CHECK(exact_us(timeout_ticks, prescaler) >= timeout
+                  && (!timeout_ticks || exact_us(timeout_ticks - 1, prescaler) < timeout),
+                  "%u us at prescaler %u is %u ticks", timeout, prescaler, timeout_ticks);
+        }
+    }
+}
+
+/**@brief   Timestamps taken at random every update tick or so, as us_timestamp is, against real time.
+ *
+ * Elapsed time by unsigned subtraction of timestamps stays within 1 us of real time, however long it runs & however
+ * many times timestamps wrap at 2^32 us.
+ */
+static void check_drift(uint64_t start_ticks, uint64_t duration, char const *name) {
+    rtc_time_t time = {.ticks = start_ticks, .last_count = start_ticks & RTC_COUNTER_MASK};
+    uint64_t ticks = start_ticks;
+    uint32_t first = rtc_ticks_us(rtc_time_update(&time, ticks & RTC_COUNTER_MASK), 0);
+    uint32_t previous = first;
+    uint64_t summed_us = 0;
+    double max_error = 0;
+    uint32_t wraps = 0;
+    while (ticks - start_ticks < duration) {
+        ticks += 1 + rand() % 300;
+        uint32_t now = rtc_ticks_us(rtc_time_update(&time, ticks & RTC_COUNTER_MASK), 0);
+        if (now < previous) wraps++;
+        summed_us += (uint32_t) (now - previous);
+        previous = now;
+        double real_us = (double) (ticks - start_ticks) * 1e6 / RTC_FREQUENCY_Hz;
+        double error = real_us - (double) summed_us;
+        if (error < 0) error = -error;
+        if (error > max_error) max_error = error;
+    }
+    printf("%s: %llu us summed over %u timestamp wraps, max error %.3f us\n", name, (unsigned long long) summed_us,
+           wraps, max_error);
+    CHECK(max_error < 1, "%s: drifted %.3f us", name, max_error);
+}
+
+static void test_drift(void) {
+    srand(3);
+    check_drift(0, SECONDS(600), "10 minutes");
+    // Starting 5 minutes before timestamps wrap, at an odd tick
+    uint64_t wrap_ticks = ((1ULL << 32) << RTC_TICK_US_SHIFT) / RTC_TICK_US_NUM(0);
+    check_drift(wrap_ticks - SECONDS(300) + 7, SECONDS(600), "10 minutes across the 2^32 us wrap");
+    check_drift(12345, SECONDS(24 * 3600), "24 hours");
+}
+
+int main(void) {
+    test_counter_overflow();
+    test_extension();
+    test_conversion();
+    test_drift();
+    return UNIT_TEST_RESULT();
+}
@@ -0,0 +1,254 @@
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "triple_buffer.h"
+#include "unit_test.h"
+
+/*
+ * Preemption stress test of triple_buffer.h, as set_pulse & update_pulse_edges use it.
+ *
+ * The x86 trap flag raises SIGTRAP after every instruction, and the handler stands in for an interrupt. First the
+ * reader preempts the writer filling & publishing slots, then the writer preempts the reader taking & reading them,
+ * then a second writer preempts the first, each in a critical region as set_pulse's callers are.
+ * Each pass preempts at a set of instruction boundaries: every single boundary & every pair of boundaries in turn,
+ * then random sets, as one preemption can hide a fault another would show. Slots are filled with a sequence number
+ * in every word, so a torn slot has mismatched words.
+ */
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "Single stepping needs x86-64 Linux"
+#endif
+
+#define EFLAGS_TF 0x100
+#define SLOT_WORDS 6
+// Instruction boundaries a pass can be preempted at
+#define BOUNDARIES 64
+#define ITERATIONS (BOUNDARIES + BOUNDARIES * (BOUNDARIES - 1) / 2 + 20000)
+#define NO_SLOT 0xFF
+
+typedef struct {
+    uint32_t words[SLOT_WORDS];
+} slot_t;
+
+static slot_t volatile slots[3];
+static triple_buffer_t buffer = TRIPLE_BUFFER_INIT;
+
+static bool volatile stepping;
+static void (*volatile preempt)(void);
+static uint64_t preempt_boundaries;
+static uint32_t boundary, max_boundaries;
+static uint32_t volatile preemptions;
+// Critical region in progress, which holds a preemption due inside it back until it ends
+static bool volatile masked;
+static bool pending;
+static uint32_t held;
+
+static void on_trap(int __attribute__((unused)) signal, siginfo_t __attribute__((unused)) *p_info, void *p_context) {
+    ucontext_t *p_ucontext = p_context;
+    if (!stepping) {
+        p_ucontext->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+        return;
+    }
+    if (boundary < BOUNDARIES && preempt_boundaries >> boundary & 1) pending = true;
+    if (pending && masked) held++;
+    if (pending && !masked) {
+        pending = false;
+        preemptions++;
+        preempt();
+    }
+    boundary++;
+}
+
+static uint64_t random_u64(void) {
+    static uint64_t state = 88172645463325252ULL;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/// Boundaries to preempt an iteration at: each one alone, each pair, then random sets.
+static uint64_t iteration_boundaries(uint32_t iteration) {
+    if (iteration < BOUNDARIES) return 1ULL << iteration;
+    iteration -= BOUNDARIES;
+    for (uint32_t first = 0; first < BOUNDARIES; first++) {
+        uint32_t pairs = BOUNDARIES - 1 - first;
+        if (iteration < pairs) return 1ULL << first | 1ULL << (first + 1 + iteration);
+        iteration -= pairs;
+    }
+    switch (iteration % 3) {
+        case 0: return random_u64() & random_u64() & random_u64();
+        case 1: return random_u64();
+        default: return UINT64_MAX;
+    }
+}
+
+static inline void step_start(uint32_t iteration) {
+    preempt_boundaries = iteration_boundaries(iteration);
+    boundary = 0;
+    pending = false;
+    stepping = true;
+    __asm__ volatile("pushfq\n\torq %0, (%%rsp)\n\tpopfq" : : "i" (EFLAGS_TF) : "cc", "memory");
+}
+
+static inline void step_stop(void) {
+    stepping = false;
+    // The next trap clears the flag
+    __asm__ volatile("nop" : : : "memory");
+    if (boundary > max_boundaries) max_boundaries = boundary;
+}
+
+/// Slot indexes are always a permutation of 0, 1 & 2, checked where neither side is mid-exchange.
+static void check_ownership(char const *context) {
+    uint8_t middle = buffer.middle & ~TRIPLE_BUFFER_FRESH;
+    CHECK(buffer.write < 3 && middle < 3 && buffer.read < 3 && buffer.write != middle && buffer.write != buffer.read
+          && middle != buffer.read, "%s: slots write %u, middle %u, read %u", context, buffer.write, middle,
+          buffer.read);
+}
+
+/// Sequence number a slot holds, or 0 if it's torn.
+static uint32_t slot_sequence(slot_t volatile const *p_slot) {
+    uint32_t sequence = p_slot->words[0];
+    for (uint8_t i = 1; i < SLOT_WORDS; i++) {
+        if (p_slot->words[i] != sequence) return 0;
+    }
+    return sequence;
+}
+
+/* Reader preempting the writer */
+
+static uint8_t volatile filling = NO_SLOT;
+static uint32_t volatile published;
+static uint32_t taken;
+
+static void preempting_reader(void) {
+    uint8_t read = triple_buffer_take(&buffer);
+    CHECK(read != filling, "reader took slot %u while it's being written", read);
+    uint32_t sequence = slot_sequence(&slots[read]);
+    CHECK(sequence || !taken, "reader took a torn slot %u", read);
+    CHECK(sequence >= taken, "reader went back from %u to %u", taken, sequence);
+    CHECK(sequence >= published, "reader took %u, after %u was published", sequence, published);
+    taken = sequence;
+}
+
+static void test_reader_preempts_writer(void) {
+    preempt = preempting_reader;
+    preemptions = 0;
+    max_boundaries = 0;
+    for (uint32_t sequence = 1; sequence <= ITERATIONS && unit_test_failures < 20; sequence++) {
+        step_start(sequence - 1);
+        uint8_t write = buffer.write;
+        filling = write;
+        for (uint8_t i = 0; i < SLOT_WORDS; i++) slots[write].words[i] = sequence;
+        filling = NO_SLOT;
+        triple_buffer_publish(&buffer);
+        published = sequence;
+        step_stop();
+        check_ownership("writer");
+    }
+    printf("reader preempted the writer %u times over %u writes of %u instructions\n", preemptions, ITERATIONS,
+           max_boundaries);
+    CHECK(preemptions > ITERATIONS, "only %u preemptions", preemptions);
+    CHECK(max_boundaries < BOUNDARIES, "%u instruction boundaries, more than were swept", max_boundaries);
+}
+
+/* Writer preempting the reader */
+
+static uint32_t written;
+static uint8_t volatile reading = NO_SLOT;
+
+static void preempting_writer(void) {
+    uint8_t write = buffer.write;
+    CHECK(write != reading, "writer filling slot %u while it's being read", write);
+    written++;
+    for (uint8_t i = 0; i < SLOT_WORDS; i++) slots[write].words[i] = written;
+    triple_buffer_publish(&buffer);
+}
+
+static void test_writer_preempts_reader(void) {
+    memset((void *) slots, 0, sizeof(slots));
+    buffer = (triple_buffer_t) TRIPLE_BUFFER_INIT;
+    preempt = preempting_writer;
+    preemptions = 0;
+    max_boundaries = 0;
+    uint32_t last = 0;
+    for (uint32_t iteration = 0; iteration < ITERATIONS && unit_test_failures < 20; iteration++) {
+        step_start(iteration);
+        uint8_t read = triple_buffer_take(&buffer);
+        reading = read;
+        uint32_t words[SLOT_WORDS];
+        for (uint8_t i = 0; i < SLOT_WORDS; i++) words[i] = slots[read].words[i];
+        reading = NO_SLOT;
+        step_stop();
+        for (uint8_t i = 1; i < SLOT_WORDS; i++) CHECK(words[i] == words[0], "reader read a torn slot %u", read);
+        CHECK(words[0] >= last, "reader went back from %u to %u", last, words[0]);
+        last = words[0];
+        check_ownership("reader");
+    }
+    // Once the writer stops, the reader catches up to its last write
+    uint32_t latest = slot_sequence(&slots[triple_buffer_take(&buffer)]);
+    CHECK(latest == written, "reader ended on %u, %u was published last", latest, written);
+    printf("writer preempted the reader %u times over %u reads of %u instructions\n", preemptions, ITERATIONS,
+           max_boundaries);
+    CHECK(preemptions > ITERATIONS, "only %u preemptions", preemptions);
+    CHECK(max_boundaries < BOUNDARIES, "%u instruction boundaries, more than were swept", max_boundaries);
+}
+
+/* Writer preempting a writer */
+
+static uint32_t volatile last_published;
+
+/// Fills & publishes the write slot in a critical region, as set_pulse does.
+static void critical_writer(void) {
+    // Fenced like the interrupt masking of CRITICAL_REGION_ENTER & EXIT, so nothing moves out of the region
+    masked = true;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    uint32_t sequence = ++written;
+    uint8_t write = buffer.write;
+    for (uint8_t i = 0; i < SLOT_WORDS; i++) slots[write].words[i] = sequence;
+    triple_buffer_publish(&buffer);
+    last_published = sequence;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    masked = false;
+}
+
+static void test_writer_preempts_writer(void) {
+    memset((void *) slots, 0, sizeof(slots));
+    buffer = (triple_buffer_t) TRIPLE_BUFFER_INIT;
+    written = 0;
+    preempt = critical_writer;
+    preemptions = 0;
+    held = 0;
+    max_boundaries = 0;
+    for (uint32_t iteration = 0; iteration < ITERATIONS && unit_test_failures < 20; iteration++) {
+        step_start(iteration);
+        critical_writer();
+        step_stop();
+        check_ownership("writers");
+        // Whichever writer published last, the reader takes its whole slot
+        uint8_t read = triple_buffer_take(&buffer);
+        uint32_t sequence = slot_sequence(&slots[read]);
+        CHECK(sequence, "reader took a torn slot %u", read);
+        CHECK(sequence == last_published, "reader took %u, %u was published last", sequence, last_published);
+    }
+    printf("writer preempted a writer %u times, held back to the end of its critical region at %u instructions, over "
+           "%u writes of %u instructions\n", preemptions, held, ITERATIONS, max_boundaries);
+    // Boundaries past the end of a write don't preempt it
+    CHECK(preemptions > ITERATIONS / 2, "only %u preemptions", preemptions);
+    CHECK(held > ITERATIONS / 2, "only held back %u times", held);
+    CHECK(max_boundaries < BOUNDARIES, "%u instruction boundaries, more than were swept", max_boundaries);
+}
+
+int main(void) {
+    struct sigaction action = {.sa_sigaction = on_trap, .sa_flags = SA_SIGINFO};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTRAP, &action, NULL);
+    test_reader_preempts_writer();
+    test_writer_preempts_reader();
+    test_writer_preempts_writer();
+    return UNIT_TEST_RESULT();
+}
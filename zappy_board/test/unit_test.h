@@ -0,0 +1,21 @@
+#ifndef UNIT_TEST_H
+#define UNIT_TEST_H
+
+#include <stdio.h>
+
+static unsigned unit_test_failures;
+
+/// Records & reports a failed expectation, without stopping the test.
+#define CHECK(condition, ...) do {                                              \
+    if (!(condition)) {                                                         \
+        unit_test_failures++;                                                   \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #condition); \
+        fprintf(stderr, __VA_ARGS__);                                           \
+        fputc('\n', stderr);                                                    \
+    }                                                                           \
+} while (0)
+
+/// Exit status of a test executable, for ctest.
+#define UNIT_TEST_RESULT() (unit_test_failures ? (fprintf(stderr, "%u failed\n", unit_test_failures), 1) : 0)
+
+#endif //UNIT_TEST_H